@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""
+Save the frames printed by CONFIG_DISPLAY_LOG_FRAMES from a serial log and
+optionally compare them with reference images.
+
+Usage:
+    idf.py monitor | tee monitor.log
+    python3 extract_frames.py monitor.log
+    python3 extract_frames.py monitor.log --output frames --compare golden
+"""
+
+import argparse
+import re
+import sys
+from pathlib import Path
+
+# Markers printed by display_log_frame() in display.c
+BEGIN_RE = re.compile(r"-----BEGIN FRAME (\d+)-----")
+END_MARKER = "-----END FRAME-----"
+
+
+def parse_frames(log_path: Path) -> list:
+    """Return (frame_number, pbm_text) tuples in log order."""
+    frames = []
+    current = None
+    number = 0
+
+    with open(log_path, "r", errors="replace") as log:
+        for raw in log:
+            line = raw.rstrip("\r\n")
+            match = BEGIN_RE.search(line)
+            if match:
+                number = int(match.group(1))
+                current = []
+            elif current is not None and END_MARKER in line:
+                frames.append((number, "\n".join(current) + "\n"))
+                current = None
+            elif current is not None:
+                current.append(line)
+
+    return frames
+
+
+def read_pixels(pbm_text: str) -> tuple:
+    """Parse a plain (P1) PBM and return (width, height, pixel string)."""
+    tokens = [t for l in pbm_text.splitlines() if not l.startswith("#") for t in l.split()]
+    if not tokens or tokens[0] != "P1":
+        raise ValueError("not a plain PBM (P1) image")
+    width, height = int(tokens[1]), int(tokens[2])
+    pixels = "".join(tokens[3:])
+    if len(pixels) != width * height:
+        raise ValueError(f"expected {width * height} pixels, got {len(pixels)}")
+    return width, height, pixels
+
+
+def compare(frame_path: Path, golden_path: Path) -> bool:
+    if not golden_path.exists():
+        print(f"  MISSING  {golden_path}")
+        return False
+
+    w1, h1, actual = read_pixels(frame_path.read_text())
+    w2, h2, expected = read_pixels(golden_path.read_text())
+    if (w1, h1) != (w2, h2):
+        print(f"  SIZE     {frame_path.name}: {w1}x{h1} vs {w2}x{h2}")
+        return False
+
+    diff = sum(1 for a, b in zip(actual, expected) if a != b)
+    if diff:
+        print(f"  DIFF     {frame_path.name}: {diff} pixel(s) differ")
+        return False
+
+    print(f"  OK       {frame_path.name}")
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Extract toilet-timer display frames from a serial log.",
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="""
+Examples:
+  python3 extract_frames.py monitor.log
+  python3 extract_frames.py monitor.log --output frames --compare golden
+
+Frames are written as frame_<n>.pbm in logical (as viewed) orientation.
+With --compare, each frame is checked against the file of the same name in
+the reference directory and the exit status is non-zero on any difference.
+        """
+    )
+    parser.add_argument("log", help="Serial log captured with CONFIG_DISPLAY_LOG_FRAMES enabled")
+    parser.add_argument(
+        "--output", metavar="DIR", default="frames",
+        help="Directory to write the PBM files to (default: frames)",
+    )
+    parser.add_argument(
+        "--compare", metavar="DIR",
+        help="Directory with reference PBM files to compare against",
+    )
+    args = parser.parse_args()
+
+    frames = parse_frames(Path(args.log))
+    if not frames:
+        print("ERROR: No frames found. Is CONFIG_DISPLAY_LOG_FRAMES enabled?")
+        sys.exit(1)
+
+    out_dir = Path(args.output)
+    out_dir.mkdir(parents=True, exist_ok=True)
+    paths = []
+    for number, pbm in frames:
+        path = out_dir / f"frame_{number}.pbm"
+        path.write_text(pbm)
+        paths.append(path)
+    print(f"Saved {len(paths)} frame(s) to {out_dir}")
+
+    if args.compare:
+        golden_dir = Path(args.compare)
+        print(f"Comparing with {golden_dir}:")
+        failures = [p for p in paths if not compare(p, golden_dir / p.name)]
+        if failures:
+            print(f"{len(failures)} of {len(paths)} frame(s) differ")
+            sys.exit(1)
+        print("All frames match")
+
+
+if __name__ == "__main__":
+    main()
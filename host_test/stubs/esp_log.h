@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdio.h>
+
+/* Errors logged by the code under test; a passing run leaves this at 0 */
+extern int host_log_errors;
+
+#define ESP_LOGE(tag, fmt, ...) \
+    do { host_log_errors++; fprintf(stderr, "E (%s) " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) do { (void)(tag); } while (0)
+#define ESP_LOGD(tag, fmt, ...) do { (void)(tag); } while (0)
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
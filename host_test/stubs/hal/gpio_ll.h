@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "driver/gpio.h"
+
+typedef struct gpio_dev_s gpio_dev_t;
+
+#define GPIO_PORT_0 0
+#define GPIO_LL_GET_HW(num) ((gpio_dev_t *)NULL)
+
+static inline int gpio_ll_get_level(gpio_dev_t *hw, uint32_t gpio_num) { return 1; }
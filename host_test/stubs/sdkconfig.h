@@ -0,0 +1,7 @@
+/* Host build configuration: Kconfig defaults for the code under test */
+#pragma once
+
+#define CONFIG_DISPLAY_WIDTH 80
+#define CONFIG_DISPLAY_HEIGHT 128
+#define CONFIG_BUTTON_RIGHT_GPIO 4
+#define CONFIG_SNTP_TIMEZONE "CET-1CEST,M3.5.0,M10.5.0/3"
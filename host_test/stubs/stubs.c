@@ -0,0 +1,33 @@
+/* Link stubs for the parts of trigger.c the host test does not exercise */
+
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/gpio.h"
+#include "global_event_group.h"
+#include "rtc_state/rtc_state.h"
+
+int host_log_errors;
+
+EventGroupHandle_t global_event_group;
+
+TickType_t xTaskGetTickCount(void) { return 0; }
+TickType_t xTaskGetTickCountFromISR(void) { return 0; }
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) { return NULL; }
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken) { return pdFALSE; }
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout) { return pdFALSE; }
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) { return 0; }
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) { return 0; }
+BaseType_t xEventGroupSetBitsFromISR(EventGroupHandle_t group, EventBits_t bits, BaseType_t *woken) { return pdFALSE; }
+
+esp_err_t gpio_config(const gpio_config_t *config) { return ESP_OK; }
+int gpio_get_level(gpio_num_t gpio_num) { return 1; }
+esp_err_t gpio_install_isr_service(int flags) { return ESP_OK; }
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t handler, void *arg) { return ESP_OK; }
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num) { return ESP_OK; }
+
+time_t rtc_state_get_last_trigger(void) { return 0; }
+esp_err_t rtc_state_set_last_trigger(time_t timestamp) { return ESP_OK; }
@@ -0,0 +1,131 @@
+/**
+ * @file test_glyphs.c
+ * @brief Host test of the glyph blitter against the per-pixel renderer
+ *
+ * Draws every glyph with draw_string(), which blits whole glyph columns into
+ * the physical framebuffer rows, and with one draw_pixel() per set bit, at
+ * every vertical offset (each bit alignment and clipping at the top and
+ * bottom edges) and at clipped and unclipped horizontal positions, in both
+ * colors. The two frames must be identical.
+ *
+ * Also checks that font_ua_9x15_index, which is maintained by hand, points
+ * every indexed codepoint at its own glyph and indexes every Cyrillic glyph.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "global_constants.h"
+#include "display_epaper/graphics.h"
+#include "display_epaper/fonts/font_9x15.h"
+
+#define FRAME_SIZE ((CONFIG_DISPLAY_WIDTH * CONFIG_DISPLAY_HEIGHT) / 8)
+#define LOGICAL_WIDTH CONFIG_DISPLAY_HEIGHT
+#define LOGICAL_HEIGHT CONFIG_DISPLAY_WIDTH
+
+static const int s_offsets_x[] = { -8, -3, 0, 1, 7, 61, LOGICAL_WIDTH - FONT_CHAR_WIDTH };
+
+static void encode_utf8(uint32_t codepoint, char *buf)
+{
+    if (codepoint < 0x80) {
+        buf[0] = (char)codepoint;
+        buf[1] = '\0';
+    } else {
+        buf[0] = (char)(0xC0 | (codepoint >> 6));
+        buf[1] = (char)(0x80 | (codepoint & 0x3F));
+        buf[2] = '\0';
+    }
+}
+
+static void draw_glyph_per_pixel(uint8_t *frame, int x, int y, const uint16_t *glyph, uint8_t color)
+{
+    for (int col = 0; col < FONT_CHAR_WIDTH; col++) {
+        for (int row = 0; row < FONT_CHAR_HEIGHT; row++) {
+            if (glyph[col] & (1 << row)) {
+                draw_pixel(frame, x + col, y + row, color);
+            }
+        }
+    }
+}
+
+static int check_glyph(uint32_t codepoint, const uint16_t *glyph)
+{
+    static uint8_t expected[FRAME_SIZE];
+    static uint8_t actual[FRAME_SIZE];
+    char text[4];
+    encode_utf8(codepoint, text);
+
+    for (size_t ix = 0; ix < sizeof(s_offsets_x) / sizeof(s_offsets_x[0]); ix++) {
+        for (int y = 1 - FONT_CHAR_HEIGHT; y < LOGICAL_HEIGHT; y++) {
+            for (uint8_t color = 0; color <= 1; color++) {
+                memset(expected, color ? 0x00 : 0xFF, sizeof(expected));
+                memset(actual, color ? 0x00 : 0xFF, sizeof(actual));
+                draw_glyph_per_pixel(expected, s_offsets_x[ix], y, glyph, color);
+                draw_string(actual, s_offsets_x[ix], y, text, color);
+                if (memcmp(expected, actual, sizeof(expected)) != 0) {
+                    printf("  FAIL     U+%04X at x=%d y=%d color=%d\n",
+                           (unsigned)codepoint, s_offsets_x[ix], y, color);
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static int check_index(void)
+{
+    int failures = 0;
+
+    for (uint32_t offset = 0; offset < FONT_UA_INDEX_SIZE; offset++) {
+        uint8_t entry = font_ua_9x15_index[offset];
+        if (entry == 0) {
+            continue;
+        }
+        if (entry > font_ua_9x15_count) {
+            printf("  FAIL     index of U+%04X points past the glyph table (%u)\n",
+                   (unsigned)(FONT_UA_INDEX_FIRST + offset), entry);
+            failures++;
+        } else if (font_ua_9x15[entry - 1].codepoint != FONT_UA_INDEX_FIRST + offset) {
+            printf("  FAIL     index of U+%04X points at the glyph for U+%04X\n",
+                   (unsigned)(FONT_UA_INDEX_FIRST + offset), font_ua_9x15[entry - 1].codepoint);
+            failures++;
+        }
+    }
+
+    for (size_t i = 0; i < font_ua_9x15_count; i++) {
+        uint32_t offset = font_ua_9x15[i].codepoint - FONT_UA_INDEX_FIRST;
+        if (offset >= FONT_UA_INDEX_SIZE || font_ua_9x15_index[offset] != i + 1) {
+            printf("  FAIL     glyph U+%04X is not indexed\n", font_ua_9x15[i].codepoint);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(void)
+{
+    graphics_init(CONFIG_DISPLAY_WIDTH, CONFIG_DISPLAY_HEIGHT);
+
+    int failures = check_index();
+    for (uint32_t codepoint = 32; codepoint <= 126; codepoint++) {
+        failures += check_glyph(codepoint, font_9x15[codepoint - 32]);
+    }
+    for (size_t i = 0; i < font_ua_9x15_count; i++) {
+        failures += check_glyph(font_ua_9x15[i].codepoint, font_ua_9x15[i].glyph);
+    }
+
+    if (host_log_errors != 0) {
+        printf("%d error(s) logged\n", host_log_errors);
+        failures++;
+    }
+
+    if (failures != 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All %zu glyphs match the per-pixel renderer\n", (size_t)(126 - 32 + 1) + font_ua_9x15_count);
+    return 0;
+}
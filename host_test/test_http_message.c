@@ -0,0 +1,146 @@
+/**
+ * @file test_http_message.c
+ * @brief Host test of the request and response handling behind https_get()
+ *
+ * Splits manifest-style URLs, formats requests into buffers of the exact
+ * size and one byte short, and parses responses with and without an ETag,
+ * with a body, and malformed ones.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "https_get/http_message.h"
+
+#define CHECK(cond) \
+    do { if (!(cond)) { printf("  FAIL     %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static int check_split_url(void)
+{
+    int failures = 0;
+    char authority[HTTP_MESSAGE_AUTHORITY_LEN];
+    const char *path = NULL;
+
+    CHECK(http_message_split_url("https://192.168.50.123:8070/toilet-timer.json", authority, &path));
+    CHECK(strcmp(authority, "192.168.50.123:8070") == 0);
+    CHECK(strcmp(path, "/toilet-timer.json") == 0);
+
+    CHECK(http_message_split_url("https://example.com", authority, &path));
+    CHECK(strcmp(authority, "example.com") == 0);
+    CHECK(strcmp(path, "/") == 0);
+
+    CHECK(!http_message_split_url("http://example.com/", authority, &path));
+    CHECK(!http_message_split_url("https:///toilet-timer.json", authority, &path));
+    CHECK(!http_message_split_url(NULL, authority, &path));
+
+    char url[HTTP_MESSAGE_AUTHORITY_LEN + 16] = "https://";
+    memset(url + 8, 'a', HTTP_MESSAGE_AUTHORITY_LEN);
+    strcpy(url + 8 + HTTP_MESSAGE_AUTHORITY_LEN, "/x");
+    CHECK(!http_message_split_url(url, authority, &path));
+    return failures;
+}
+
+static int check_format_request(void)
+{
+    static const char expected[] =
+        "GET /toilet-timer.json HTTP/1.0\r\n"
+        "Host: 192.168.50.123:8070\r\n"
+        "ESP32-MAC: 01:23:45:67:89:AB\r\n"
+        "If-None-Match: \"5f2a\"\r\n"
+        "Connection: close\r\n"
+        "\r\n";
+    static const https_get_header_t headers[] = {
+        { "ESP32-MAC", "01:23:45:67:89:AB" },
+        { "If-None-Match", "\"5f2a\"" },
+    };
+    int failures = 0;
+    char buf[256];
+
+    int len = http_message_format_request(buf, sizeof(buf), "192.168.50.123:8070", "/toilet-timer.json", headers, 2);
+    CHECK(len == (int)strlen(expected));
+    CHECK(strcmp(buf, expected) == 0);
+
+    /* Room for the terminator is required */
+    CHECK(http_message_format_request(buf, sizeof(expected), "192.168.50.123:8070", "/toilet-timer.json",
+                                      headers, 2) == len);
+    CHECK(http_message_format_request(buf, sizeof(expected) - 1, "192.168.50.123:8070", "/toilet-timer.json",
+                                      headers, 2) == -1);
+    CHECK(http_message_format_request(buf, 20, "192.168.50.123:8070", "/toilet-timer.json", headers, 2) == -1);
+
+    CHECK(http_message_format_request(buf, sizeof(buf), "example.com", "/", NULL, 0) > 0);
+    CHECK(strcmp(buf, "GET / HTTP/1.0\r\nHost: example.com\r\nConnection: close\r\n\r\n") == 0);
+    return failures;
+}
+
+static void parse(const char *text, https_get_response_t *response, esp_err_t *err)
+{
+    static char buf[512];
+    snprintf(buf, sizeof(buf), "%s", text);
+    memset(response, 0xA5, sizeof(*response));
+    *err = http_message_parse_response(buf, strlen(buf), response);
+}
+
+static int check_parse_response(void)
+{
+    int failures = 0;
+    https_get_response_t response;
+    esp_err_t err;
+
+    parse("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nETag: \"5f2a\"\r\n\r\n{\"version\":\"1.2\"}",
+          &response, &err);
+    CHECK(err == ESP_OK);
+    CHECK(response.status == 200);
+    CHECK(strcmp(response.etag, "\"5f2a\"") == 0);
+    CHECK(response.body_len == strlen("{\"version\":\"1.2\"}"));
+    CHECK(strcmp(response.body, "{\"version\":\"1.2\"}") == 0);
+
+    parse("HTTP/1.0 304 Not Modified\r\netag:\tW/\"5f2a\"\r\n\r\n", &response, &err);
+    CHECK(err == ESP_OK);
+    CHECK(response.status == 304);
+    CHECK(strcmp(response.etag, "W/\"5f2a\"") == 0);
+    CHECK(response.body_len == 0);
+    CHECK(strcmp(response.body, "") == 0);
+
+    /* An ETag too long to keep is dropped rather than truncated */
+    char text[256];
+    snprintf(text, sizeof(text), "HTTP/1.1 404 Not Found\r\nETag: \"%0*d\"\r\n\r\nmissing", HTTPS_GET_ETAG_LEN, 0);
+    parse(text, &response, &err);
+    CHECK(err == ESP_OK);
+    CHECK(response.status == 404);
+    CHECK(response.etag[0] == '\0');
+    CHECK(strcmp(response.body, "missing") == 0);
+
+    /* "ETag:" inside another header's value or in the body is not a header */
+    parse("HTTP/1.1 200 OK\r\nX-Note: ETag: no\r\n\r\nline\r\n\r\nETag: body", &response, &err);
+    CHECK(err == ESP_OK);
+    CHECK(response.etag[0] == '\0');
+    CHECK(strcmp(response.body, "line\r\n\r\nETag: body") == 0);
+
+    parse("HTTP/1.1 200 OK\r\nETag: \"5f2a\"\r\n", &response, &err);
+    CHECK(err == ESP_ERR_INVALID_RESPONSE);
+    parse("<html>\r\n\r\n</html>", &response, &err);
+    CHECK(err == ESP_ERR_INVALID_RESPONSE);
+    parse("", &response, &err);
+    CHECK(err == ESP_ERR_INVALID_RESPONSE);
+    return failures;
+}
+
+int main(void)
+{
+    int failures = check_split_url();
+    failures += check_format_request();
+    failures += check_parse_response();
+
+    if (host_log_errors != 0) {
+        printf("%d error(s) logged\n", host_log_errors);
+        failures++;
+    }
+
+    if (failures != 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All HTTP message checks passed\n");
+    return 0;
+}
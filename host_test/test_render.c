@@ -0,0 +1,196 @@
+/**
+ * @file test_render.c
+ * @brief Host test of the rendered day-count frames
+ *
+ * Formats each case with trigger_format_datetime(), draws it the way
+ * show_messages does and compares the frame with a golden PBM. Frames are
+ * written to the output directory in the same format as display_log_frame(),
+ * so a changed frame can be inspected and, if intended, copied over its
+ * golden image.
+ *
+ * Usage: test_render <golden dir> <output dir>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "display_epaper/graphics.h"
+#include "time_utils/time_utils.h"
+#include "trigger/trigger.h"
+
+#define FRAME_SIZE ((CONFIG_DISPLAY_WIDTH * CONFIG_DISPLAY_HEIGHT) / 8)
+#define BYTES_PER_ROW (CONFIG_DISPLAY_WIDTH / 8)
+
+/* Logical frame as printed by display_log_frame(): header plus one line per row */
+#define PBM_SIZE (32 + CONFIG_DISPLAY_WIDTH * (CONFIG_DISPLAY_HEIGHT + 1))
+
+typedef struct {
+    const char *name;
+    int days;               /* Days since the trigger, -1 before the first SNTP sync */
+    const char *text;       /* Drawn as is instead of a formatted trigger time */
+} render_case_t;
+
+static const render_case_t s_cases[] = {
+    { "connecting",  0, " Підключаю\n Wi-Fi для\n отримання\n часу" },
+    { "unsynced",   -1, NULL },
+    { "today",       0, NULL },
+    { "yesterday",   1, NULL },
+    { "days_2",      2, NULL },
+    { "days_5",      5, NULL },
+    { "days_11",    11, NULL },
+    { "days_21",    21, NULL },
+    { "days_22",    22, NULL },
+    { "days_112",  112, NULL },
+    /* Too wide for the day line: the wrapped rest falls below the panel */
+    { "days_12345", 12345, NULL },
+    /* Wraps at the right edge and stops after the last line that fits */
+    { "wrap_clip",   0, "Дуже довгий рядок, що переноситься і обрізається знизу" },
+};
+
+static const struct {
+    int days;
+    const char *suffix;
+} s_suffixes[] = {
+    { 1, "день" }, { 2, "дні" }, { 4, "дні" }, { 5, "днів" }, { 11, "днів" },
+    { 12, "днів" }, { 14, "днів" }, { 20, "днів" }, { 21, "день" }, { 22, "дні" },
+    { 25, "днів" }, { 101, "день" }, { 111, "днів" }, { 112, "днів" }, { 1000, "днів" },
+};
+
+/* Same layout as display_log_frame(): logical orientation, '1' for black */
+static void frame_to_pbm(const uint8_t *frame, char *pbm, size_t size)
+{
+    int len = snprintf(pbm, size, "P1\n%d %d\n", CONFIG_DISPLAY_HEIGHT, CONFIG_DISPLAY_WIDTH);
+    for (int y = 0; y < CONFIG_DISPLAY_WIDTH; y++) {
+        int phys_x = CONFIG_DISPLAY_WIDTH - 1 - y;
+        for (int x = 0; x < CONFIG_DISPLAY_HEIGHT; x++) {
+            uint8_t byte = frame[x * BYTES_PER_ROW + phys_x / 8];
+            pbm[len++] = (byte & (0x80 >> (phys_x % 8))) ? '0' : '1';
+        }
+        pbm[len++] = '\n';
+    }
+    pbm[len] = '\0';
+}
+
+static void render(const render_case_t *test, char *pbm, size_t size)
+{
+    char text[128];
+    uint8_t frame[FRAME_SIZE];
+
+    if (test->text != NULL) {
+        snprintf(text, sizeof(text), "%s", test->text);
+    } else {
+        /* 14-03-2025 07:05:09, viewed a few hours later on the given day */
+        struct tm trigger_tm = { .tm_year = 125, .tm_mon = 2, .tm_mday = 14,
+                                 .tm_hour = 7, .tm_min = 5, .tm_sec = 9, .tm_isdst = -1 };
+        time_t trigger = mktime(&trigger_tm);
+
+        struct tm now_tm = trigger_tm;
+        now_tm.tm_mday += test->days < 0 ? 0 : test->days;
+        now_tm.tm_hour += 11;
+        now_tm.tm_isdst = -1;
+        time_t now = mktime(&now_tm);
+
+        int days = test->days < 0 ? -1 : time_utils_days_between(trigger, now);
+        trigger_format_datetime(text, sizeof(text), days, trigger);
+    }
+
+    /* display_clear() and display_draw_text(0, 0, text, 0) */
+    memset(frame, 0xFF, sizeof(frame));
+    draw_string(frame, 0, 0, text, 0);
+    frame_to_pbm(frame, pbm, size);
+}
+
+static char *read_file(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    char *data = calloc(1, PBM_SIZE + 1);
+    if (data != NULL) {
+        fread(data, 1, PBM_SIZE, file);
+    }
+    fclose(file);
+    return data;
+}
+
+static void write_file(const char *path, const char *data)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        return;
+    }
+    fputs(data, file);
+    fclose(file);
+}
+
+static int check_suffixes(void)
+{
+    int failures = 0;
+
+    for (size_t i = 0; i < sizeof(s_suffixes) / sizeof(s_suffixes[0]); i++) {
+        const char *suffix = time_utils_get_days_suffix_uk(s_suffixes[i].days);
+        if (strcmp(suffix, s_suffixes[i].suffix) != 0) {
+            printf("  FAIL     %d %s, expected %s\n", s_suffixes[i].days, suffix, s_suffixes[i].suffix);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <golden dir> <output dir>\n", argv[0]);
+        return 2;
+    }
+    const char *golden_dir = argv[1];
+    const char *output_dir = argv[2];
+    mkdir(output_dir, 0755);
+
+    time_utils_init_timezone();
+    graphics_init(CONFIG_DISPLAY_WIDTH, CONFIG_DISPLAY_HEIGHT);
+
+    int failures = check_suffixes();
+
+    static char pbm[PBM_SIZE];
+    char path[512];
+    for (size_t i = 0; i < sizeof(s_cases) / sizeof(s_cases[0]); i++) {
+        render(&s_cases[i], pbm, sizeof(pbm));
+
+        snprintf(path, sizeof(path), "%s/%s.pbm", output_dir, s_cases[i].name);
+        write_file(path, pbm);
+
+        snprintf(path, sizeof(path), "%s/%s.pbm", golden_dir, s_cases[i].name);
+        char *golden = read_file(path);
+        if (golden == NULL) {
+            printf("  MISSING  %s\n", path);
+            failures++;
+        } else if (strcmp(golden, pbm) != 0) {
+            printf("  DIFF     %s.pbm\n", s_cases[i].name);
+            failures++;
+        } else {
+            printf("  OK       %s.pbm\n", s_cases[i].name);
+        }
+        free(golden);
+    }
+
+    if (host_log_errors != 0) {
+        printf("%d error(s) logged\n", host_log_errors);
+        failures++;
+    }
+
+    if (failures != 0) {
+        printf("%d check(s) failed, frames written to %s\n", failures, output_dir);
+        return 1;
+    }
+    printf("All frames match\n");
+    return 0;
+}
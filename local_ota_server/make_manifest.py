@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""
+Write the OTA manifest that the firmware checks before downloading an image.
+
+A raw deflate copy of the image (<image>.deflate) is written next to it for
+devices that have no matching patch.
+
+With --releases, a delta patch is built from each release archived in that
+folder (requires `pip install detools`). Devices running one of those
+releases download the patch instead of the full image. Only images passed
+with --archive are added to the folder, so it holds the releases that were
+actually shipped rather than every build, and only the newest --keep of
+them are kept.
+
+Usage:
+    python3 make_manifest.py toilet-timer.bin
+    python3 make_manifest.py toilet-timer.bin --releases releases
+    python3 make_manifest.py toilet-timer.bin --releases releases --archive
+    python3 make_manifest.py ../build/toilet-timer.bin --output toilet-timer.json
+"""
+
+import argparse
+import hashlib
+import io
+import json
+import shutil
+import struct
+import sys
+import zlib
+from pathlib import Path
+
+# Image layout (esp_image_format.h / esp_app_desc.h)
+IMAGE_MAGIC = 0xE9
+HASH_APPENDED_OFFSET = 23
+APP_DESC_OFFSET = 32  # 24-byte image header + 8-byte first segment header
+APP_DESC_MAGIC = 0xABCD5432
+APP_DESC_VERSION_OFFSET = APP_DESC_OFFSET + 16
+APP_DESC_VERSION_LEN = 32
+DIGEST_LEN = 32
+
+# Patch header (must match DELTA_PATCH_* in main/ota_update/ota_update.c)
+PATCH_MAGIC = 0xFCCDDE10
+PATCH_HEADER_LEN = 64
+
+# Deflate window (must match COMPRESSED_WINDOW_LEN in main/ota_update/ota_update.c)
+DEFLATE_WINDOW_BITS = 12
+
+# Archived releases kept for delta patches, newest first
+DEFAULT_KEEP_RELEASES = 5
+
+
+def read_version(image: bytes) -> str:
+    """Return the version string from the app descriptor."""
+    (magic,) = struct.unpack_from("<I", image, APP_DESC_OFFSET)
+    if magic != APP_DESC_MAGIC:
+        raise ValueError("app descriptor not found")
+    raw = image[APP_DESC_VERSION_OFFSET:APP_DESC_VERSION_OFFSET + APP_DESC_VERSION_LEN]
+    return raw.split(b"\0", 1)[0].decode("ascii", errors="replace")
+
+
+def read_digest(image: bytes) -> bytes:
+    """Return the SHA-256 appended to the image.
+
+    This is what esp_partition_get_sha256() reports for an app partition,
+    so the firmware can compare it with its own running partition.
+    """
+    if image[HASH_APPENDED_OFFSET] != 1:
+        raise ValueError("image has no appended SHA-256")
+    digest = image[-DIGEST_LEN:]
+    if hashlib.sha256(image[:-DIGEST_LEN]).digest() != digest:
+        raise ValueError("appended SHA-256 does not match the image contents")
+    return digest
+
+
+def is_app_image(image: bytes) -> bool:
+    return len(image) >= APP_DESC_VERSION_OFFSET + APP_DESC_VERSION_LEN and image[0] == IMAGE_MAGIC
+
+
+def write_compressed(image: bytes, image_path: Path) -> dict:
+    """Write the raw deflate stream the device inflates through its small window."""
+    compressor = zlib.compressobj(9, zlib.DEFLATED, -DEFLATE_WINDOW_BITS, 9)
+    data = compressor.compress(image) + compressor.flush()
+
+    compressed_path = image_path.with_name(image_path.name + ".deflate")
+    compressed_path.write_bytes(data)
+    print(f"Compressed image: {compressed_path.name}, {len(data)} bytes ({100 * len(data) // len(image)}%)")
+    return {"file": compressed_path.name, "size": len(data)}
+
+
+def archive_release(image_path: Path, digest: bytes, releases: Path, keep: int) -> None:
+    """Add the image to the releases folder and drop all but the newest `keep`."""
+    releases.mkdir(parents=True, exist_ok=True)
+    shutil.copyfile(image_path, releases / f"{digest.hex()[:16]}.bin")
+
+    archived = sorted(releases.glob("*.bin"), key=lambda path: path.stat().st_mtime, reverse=True)
+    for old_path in archived[keep:]:
+        print(f"Removing old release {old_path.name}")
+        old_path.unlink()
+
+
+def make_patches(image: bytes, image_path: Path, releases: Path) -> list:
+    """Build a patch to the new image from every archived release.
+
+    Returns the manifest "patches" entries.
+    """
+    if not releases.is_dir():
+        print(f"WARNING: no releases archived in {releases}, no delta patches")
+        return []
+    digest = read_digest(image)
+
+    try:
+        import detools
+    except ImportError:
+        print("WARNING: detools not installed, no delta patches (pip install detools)")
+        return []
+
+    entries = []
+
+    for base_path in sorted(releases.glob("*.bin")):
+        base = base_path.read_bytes()
+        if not is_app_image(base):
+            continue
+        try:
+            base_digest = read_digest(base)
+        except ValueError as err:
+            print(f"WARNING: skipping {base_path.name}: {err}")
+            continue
+        if base_digest == digest:
+            continue
+
+        # esp_delta_ota only decompresses heatshrink
+        patch = io.BytesIO()
+        detools.create_patch(io.BytesIO(base), io.BytesIO(image), patch, compression="heatshrink")
+        header = struct.pack("<I", PATCH_MAGIC) + base_digest
+        header += b"\0" * (PATCH_HEADER_LEN - len(header))
+
+        patch_name = f"{image_path.stem}-{base_digest.hex()[:16]}.patch"
+        (image_path.parent / patch_name).write_bytes(header + patch.getvalue())
+        entries.append({"from": base_digest.hex(), "file": patch_name})
+        print(f"Patch from {read_version(base)}: {patch_name}, "
+              f"{PATCH_HEADER_LEN + len(patch.getvalue())} bytes")
+
+    return entries
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Generate the OTA manifest for a firmware image")
+    parser.add_argument("image", type=Path, help="application .bin")
+    parser.add_argument("--output", "-o", type=Path, help="manifest path (default: <image>.json)")
+    parser.add_argument("--releases", type=Path,
+                        help="folder of released images to build delta patches from")
+    parser.add_argument("--archive", action="store_true",
+                        help="add the image to the --releases folder (use for images that are shipped)")
+    parser.add_argument("--keep", type=int, default=DEFAULT_KEEP_RELEASES,
+                        help=f"releases to keep when archiving (default: {DEFAULT_KEEP_RELEASES})")
+    args = parser.parse_args()
+
+    if args.archive and args.releases is None:
+        parser.error("--archive needs --releases")
+    if args.keep < 1:
+        parser.error("--keep must be at least 1")
+
+    image = args.image.read_bytes()
+    if not is_app_image(image):
+        print(f"ERROR: {args.image} is not an ESP application image")
+        return 1
+
+    try:
+        manifest = {
+            "version": read_version(image),
+            "size": len(image),
+            "sha256": read_digest(image).hex(),
+            "compressed": write_compressed(image, args.image),
+        }
+        if args.archive:
+            archive_release(args.image, read_digest(image), args.releases, args.keep)
+        if args.releases is not None:
+            patches = make_patches(image, args.image, args.releases)
+            if patches:
+                manifest["patches"] = patches
+    except ValueError as err:
+        print(f"ERROR: {args.image}: {err}")
+        return 1
+
+    output = args.output or args.image.with_suffix(".json")
+    output.write_text(json.dumps(manifest, indent=2) + "\n")
+    print(f"Wrote {output}: version {manifest['version']}, {manifest['size']} bytes")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
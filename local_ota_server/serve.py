@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""
+HTTPS server for local OTA testing that answers manifest checks with ETags.
+
+Usage:
+    python3 serve.py
+    python3 serve.py --port 8070 --cert ../main/ota_update/cert.pem --key key.pem
+"""
+
+import argparse
+import hashlib
+import ssl
+import sys
+from functools import partial
+from http.server import SimpleHTTPRequestHandler, ThreadingHTTPServer
+from pathlib import Path
+
+
+class OtaRequestHandler(SimpleHTTPRequestHandler):
+    """Static files with a content-hash ETag and 304 on If-None-Match."""
+
+    protocol_version = "HTTP/1.1"
+
+    def end_headers(self):
+        self.send_header("Cache-Control", "no-cache")
+        super().end_headers()
+
+    def send_head(self):
+        path = Path(self.translate_path(self.path))
+        if path.is_file():
+            etag = '"' + hashlib.sha256(path.read_bytes()).hexdigest()[:32] + '"'
+            if self.headers.get("If-None-Match") == etag:
+                self.send_response(304)
+                self.send_header("ETag", etag)
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return None
+            self._etag = etag
+        return super().send_head()
+
+    def send_header(self, keyword, value):
+        super().send_header(keyword, value)
+        # SimpleHTTPRequestHandler sends Last-Modified right before ending a 200
+        if keyword == "Last-Modified" and getattr(self, "_etag", None):
+            super().send_header("ETag", self._etag)
+            self._etag = None
+
+    def log_request(self, code="-", size="-"):
+        mac = self.headers.get("ESP32-MAC", "-")
+        self.log_message('"%s" %s %s mac=%s', self.requestline, str(code), str(size), mac)
+
+
+def main() -> int:
+    here = Path(__file__).resolve().parent
+    parser = argparse.ArgumentParser(description="Serve the OTA image and manifest over HTTPS")
+    parser.add_argument("--port", type=int, default=8070)
+    parser.add_argument("--cert", type=Path, default=here.parent / "main" / "ota_update" / "cert.pem")
+    parser.add_argument("--key", type=Path, default=here / "key.pem")
+    args = parser.parse_args()
+
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(args.cert, args.key)
+
+    handler = partial(OtaRequestHandler, directory=str(here))
+    server = ThreadingHTTPServer(("", args.port), handler)
+    server.socket = context.wrap_socket(server.socket, server_side=True)
+
+    print(f"Serving {here} on https://0.0.0.0:{args.port}")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -6,14 +6,16 @@
 
 #include "sdkconfig.h"
 #include "global_event_group.h"
+#include "../wake_scheduler/wake_scheduler.h"
 
 #include "battery_level.h"
 
 static const char *TAG = "Battery";
 static const gpio_num_t BATTERY_LEVEL_GPIO = CONFIG_BATTERY_LEVEL_GPIO;
 
-// As ESP32 ADC is not very stable, we use moving average to smooth the readings
-#define MOVING_AVERAGE_SIZE 10
+// As ESP32 ADC is not very stable, we average a burst of readings
+#define BATTERY_SAMPLE_COUNT 10
+#define BATTERY_SAMPLE_INTERVAL_MS 20
 
 int global_battery_level = 100;
 
@@ -26,14 +28,13 @@ void battery_level_task(void *pvParameter)
   ESP_LOGI(TAG, "Is enabled");
   adc_channel_t channel;
   adc_unit_t unit;
-  int adc_values[MOVING_AVERAGE_SIZE] = {0}; // Buffer to store recent readings
-  int adc_index = 0;                         // Current index for the buffer
-  int adc_sum = 0;                           // Sum of the buffer values
+  int adc_sum = 0;
 
   esp_err_t err = adc_oneshot_io_to_channel(BATTERY_LEVEL_GPIO, &unit, &channel);
   if (err != ESP_OK)
   {
     ESP_LOGE(TAG, "Pin %d is not ADC pin!", BATTERY_LEVEL_GPIO);
+    wake_scheduler_complete(WAKE_JOB_BATTERY, WAKE_OUTCOME_FAILED);
     vTaskDelete(NULL);
   }
   else
@@ -54,39 +55,37 @@ void battery_level_task(void *pvParameter)
 
   ESP_LOGI(TAG, "Init end");
 
-  while (true)
+  // One measurement per wake is enough; the device is asleep in between
+  for (int i = 0; i < BATTERY_SAMPLE_COUNT; i++)
   {
-    int adc_value;
+    int adc_value = 0;
     adc_oneshot_read(adc_handle, channel, &adc_value);
+    adc_sum += adc_value;
+    vTaskDelay(pdMS_TO_TICKS(BATTERY_SAMPLE_INTERVAL_MS));
+  }
+  adc_oneshot_del_unit(adc_handle);
 
-    // Update buffer
-    adc_sum -= adc_values[adc_index];  // Subtract the old value
-    adc_values[adc_index] = adc_value; // Add the new value
-    adc_sum += adc_value;              // Update the sum
-
-    // Update index
-    adc_index = (adc_index + 1) % MOVING_AVERAGE_SIZE;
-
-    // Calculate moving average
-    int adc_average = adc_sum / MOVING_AVERAGE_SIZE;
-
-    if (adc_average < adc_low_battery)
-    {
-      global_battery_level = 0;
-    }
-    else if (adc_average > adc_high_battery)
-    {
-      global_battery_level = 100;
-    }
-    else
-    {
-      global_battery_level = (adc_average - adc_low_battery) * 100 / (adc_high_battery - adc_low_battery);
-    }
+  int adc_average = adc_sum / BATTERY_SAMPLE_COUNT;
 
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+  if (adc_average < adc_low_battery)
+  {
+    global_battery_level = 0;
+  }
+  else if (adc_average > adc_high_battery)
+  {
+    global_battery_level = 100;
+  }
+  else
+  {
+    global_battery_level = (adc_average - adc_low_battery) * 100 / (adc_high_battery - adc_low_battery);
   }
+
+  ESP_LOGI(TAG, "Battery level: %d%% (ADC %d)", global_battery_level, adc_average);
+  wake_scheduler_complete(WAKE_JOB_BATTERY, WAKE_OUTCOME_DONE);
+  vTaskDelete(NULL);
 #else
   ESP_LOGI(TAG, "Is disabled in SDK config");
+  wake_scheduler_complete(WAKE_JOB_BATTERY, WAKE_OUTCOME_SKIPPED);
   vTaskDelete(NULL);
 #endif
 }
\ No newline at end of file
@@ -8,15 +8,70 @@
 #include <freertos/task.h>
 #include <esp_log.h>
 #include <esp_sleep.h>
+#include <esp_timer.h>
+#include <esp_attr.h>
+#include <esp_wake_stub.h>
+#include <esp_rom_sys.h>
 #include <driver/gpio.h>
+#include <soc/rtc.h>
+#include <soc/rtc_cntl_reg.h>
+#include <soc/rtc_io_reg.h>
 
 #include "deep_sleep.h"
 #include "../time_utils/time_utils.h"
+#include "../wake_profiler/wake_profiler.h"
+#include "../power_mgmt/power_mgmt.h"
 
 static const char *TAG = "deep_sleep";
 
 #define WAKEUP_GPIO_MASK ((1ULL << CONFIG_BUTTON_PUSH_GPIO) | (1ULL << CONFIG_BUTTON_LEFT_GPIO) | (1ULL << CONFIG_BUTTON_RIGHT_GPIO))
 
+/* The wake stub reads the buttons through the RTC IO input register, where
+ * RTC GPIO n is GPIO n for GPIO0-GPIO21 on the ESP32-S3 */
+_Static_assert(WAKEUP_GPIO_MASK < (1ULL << 22), "Wake-up buttons must be RTC GPIOs");
+
+#define WAKE_STUB_SAMPLE_US 1000
+
+/* Button wakes the stub sent straight back to sleep, kept across deep sleep */
+RTC_DATA_ATTR static uint32_t s_rejected_wakes;
+
+#if CONFIG_BUTTON_WAKE_DEBOUNCE_MS > 0
+static inline bool RTC_IRAM_ATTR wake_stub_button_pressed(void)
+{
+    uint32_t levels = REG_GET_FIELD(RTC_GPIO_IN_REG, RTC_GPIO_IN_NEXT);
+    return (levels & (uint32_t)WAKEUP_GPIO_MASK) != (uint32_t)WAKEUP_GPIO_MASK;
+}
+
+/* Runs from RTC memory before the bootloader. A button wake only counts if a
+ * button stays pressed for the whole debounce interval; glitches and brief
+ * contacts go back to sleep without a full boot. Timer wakes boot as usual.
+ * esp_wake_stub_sleep() re-enters sleep with the same wake-up sources, so the
+ * 1:00 AM timer target is unchanged. */
+static void RTC_IRAM_ATTR deep_sleep_wake_stub(void)
+{
+    if (esp_wake_stub_get_wakeup_cause() & RTC_EXT1_TRIG_EN) {
+        bool pressed = true;
+        for (int i = 0; i < CONFIG_BUTTON_WAKE_DEBOUNCE_MS && pressed; i++) {
+            esp_rom_delay_us(WAKE_STUB_SAMPLE_US);
+            pressed = wake_stub_button_pressed();
+        }
+
+        if (!pressed) {
+            s_rejected_wakes++;
+            REG_SET_BIT(RTC_CNTL_EXT_WAKEUP1_REG, RTC_CNTL_EXT_WAKEUP1_STATUS_CLR);
+            esp_wake_stub_sleep(&deep_sleep_wake_stub);
+        }
+    }
+
+    esp_default_wake_deep_sleep();
+}
+#endif
+
+uint32_t deep_sleep_get_rejected_wakes(void)
+{
+    return s_rejected_wakes;
+}
+
 esp_err_t deep_sleep_configure_wakeup(void)
 {
     ESP_LOGI(TAG, "Configuring deep sleep wake-up sources");
@@ -44,6 +99,11 @@ esp_err_t deep_sleep_configure_wakeup(void)
 
     ESP_LOGI(TAG, "Wake-up configured: GPIO0, GPIO3, GPIO4 (active LOW)");
 
+#if CONFIG_BUTTON_WAKE_DEBOUNCE_MS > 0
+    esp_set_deep_sleep_wake_stub(&deep_sleep_wake_stub);
+    ESP_LOGI(TAG, "Wake stub debounces button wake-ups for %d ms", CONFIG_BUTTON_WAKE_DEBOUNCE_MS);
+#endif
+
     /* Configure timer wake-up for next midnight */
     uint64_t us_until_midnight = time_utils_us_until_midnight();
     err = esp_sleep_enable_timer_wakeup(us_until_midnight);
@@ -61,6 +121,10 @@ void deep_sleep_enter(void)
 {
     ESP_LOGI(TAG, "Entering deep sleep mode...");
     ESP_LOGI(TAG, "Wake-up: GPIO0/3/4 LOW, or at 1:00 AM");
+    ESP_LOGI(TAG, "Awake for %lld ms since app start", esp_timer_get_time() / 1000);
+    wake_profiler_radio_off();
+    power_mgmt_dump();
+    wake_profiler_mark(WAKE_PHASE_DEEP_SLEEP);
 
     vTaskDelay(pdMS_TO_TICKS(100));
     esp_deep_sleep_start();
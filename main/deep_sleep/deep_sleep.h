@@ -7,6 +7,7 @@
 #define DEEP_SLEEP_H
 
 #include <esp_err.h>
+#include <stdint.h>
 
 /**
  * @brief Configure deep sleep wake-up sources (EXT1 on GPIO0, GPIO3, GPIO4)
@@ -22,4 +23,14 @@ esp_err_t deep_sleep_configure_wakeup(void);
  */
 void deep_sleep_enter(void);
 
+/**
+ * @brief Get the number of button wake-ups rejected by the wake stub
+ *
+ * Counts wake-ups where no button stayed pressed for CONFIG_BUTTON_WAKE_DEBOUNCE_MS,
+ * each one a full boot avoided. Kept in RTC memory, reset on power-on.
+ *
+ * @return Number of rejected wake-ups since power-on
+ */
+uint32_t deep_sleep_get_rejected_wakes(void);
+
 #endif // DEEP_SLEEP_H
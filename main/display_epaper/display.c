@@ -10,53 +10,119 @@
 #include "driver/epd_driver_gdew0102t4.h"
 #include "graphics.h"
 #include "global_constants.h"
+#include "../wake_profiler/wake_profiler.h"
 #include "esp_log.h"
+#include "esp_attr.h"
 #include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include <stdlib.h>
 #include <string.h>
+#ifdef CONFIG_DISPLAY_LOG_FRAMES
+#include <stdio.h>
+#endif
 
 static const char *TAG = "display";
 
+#define DISPLAY_BUFFER_SIZE ((CONFIG_DISPLAY_WIDTH * CONFIG_DISPLAY_HEIGHT) / 8)
+#define DISPLAY_BUFFER_WORDS (DISPLAY_BUFFER_SIZE / sizeof(uint32_t))
+#define DISPLAY_BYTES_PER_ROW (CONFIG_DISPLAY_WIDTH / 8)
+
+_Static_assert((CONFIG_DISPLAY_WIDTH % 8) == 0, "Display width must be a multiple of 8");
+_Static_assert((DISPLAY_BUFFER_SIZE % sizeof(uint32_t)) == 0, "Framebuffer must be a whole number of words");
+
+/* Frame currently on the panel, kept in RTC slow memory across deep sleep so
+ * every refresh can send the controller a real old/new image pair */
+RTC_DATA_ATTR static uint32_t s_shown_frame[DISPLAY_BUFFER_WORDS];
+RTC_DATA_ATTR static bool s_shown_valid;
+RTC_DATA_ATTR static int s_partial_count;  /* Fast refreshes since the last full refresh */
+RTC_DATA_ATTR static uint32_t s_refreshes_skipped;  /* Updates avoided because the frame was unchanged */
+
+/* The panel is brought up lazily by the first update that changes the frame */
+typedef enum {
+    PANEL_OFF,
+    PANEL_ON,
+    PANEL_ASLEEP,
+} panel_state_t;
+
+typedef struct {
+    display_update_cb_t callback;
+    void *arg;
+    bool sleep_after;
+} display_update_request_t;
+
 static struct {
     uint8_t *framebuffer;
+    uint8_t *pending_frame;              /* Snapshot being refreshed by the worker */
     size_t buffer_size;
+    panel_state_t panel_state;
+    QueueHandle_t update_queue;
+    SemaphoreHandle_t update_idle;       /* Given while no asynchronous update runs */
+    TaskHandle_t worker;
     bool initialized;
 } s_display = {0};
 
-esp_err_t display_init(void)
+static esp_err_t display_panel_power_up(void)
 {
-    if (s_display.initialized) {
-        ESP_LOGW(TAG, "Display already initialized");
-        return ESP_OK;
-    }
+    esp_err_t ret = ESP_OK;
 
-    /* Initialize e-paper hardware */
-    const epd_config_t epd_config = {
-        .pin_mosi = CONFIG_EPD_PIN_MOSI,
-        .pin_clk = CONFIG_EPD_PIN_CLK,
-        .pin_cs = CONFIG_EPD_PIN_CS,
-        .pin_dc = CONFIG_EPD_PIN_DC,
-        .pin_rst = CONFIG_EPD_PIN_RST,
-        .pin_busy = CONFIG_EPD_PIN_BUSY,
-        .pin_power = CONFIG_EPD_PIN_POWER,
-        .width = CONFIG_DISPLAY_WIDTH,
-        .height = CONFIG_DISPLAY_HEIGHT,
-    };
+    if (s_display.panel_state == PANEL_OFF) {
+        const epd_config_t epd_config = {
+            .pin_mosi = CONFIG_EPD_PIN_MOSI,
+            .pin_clk = CONFIG_EPD_PIN_CLK,
+            .pin_cs = CONFIG_EPD_PIN_CS,
+            .pin_dc = CONFIG_EPD_PIN_DC,
+            .pin_rst = CONFIG_EPD_PIN_RST,
+            .pin_busy = CONFIG_EPD_PIN_BUSY,
+            .pin_power = CONFIG_EPD_PIN_POWER,
+            .width = CONFIG_DISPLAY_WIDTH,
+            .height = CONFIG_DISPLAY_HEIGHT,
+        };
+        ret = epd_init(&epd_config);
+    } else if (s_display.panel_state == PANEL_ASLEEP) {
+        ret = epd_wake();
+    }
 
-    esp_err_t ret = epd_init(&epd_config);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize e-paper display");
+        ESP_LOGE(TAG, "Failed to power up e-paper display");
         return ret;
     }
 
-    /* Allocate framebuffer */
-    s_display.buffer_size = (CONFIG_DISPLAY_WIDTH * CONFIG_DISPLAY_HEIGHT) / 8;
+    s_display.panel_state = PANEL_ON;
+    wake_profiler_mark(WAKE_PHASE_DISPLAY_INIT);
+    return ESP_OK;
+}
+
+esp_err_t display_init(void)
+{
+    if (s_display.initialized) {
+        ESP_LOGW(TAG, "Display already initialized");
+        return ESP_OK;
+    }
+
+    /* Allocate framebuffer; the e-paper hardware is initialized on the first
+     * display_update() that actually changes the panel content */
+    s_display.buffer_size = DISPLAY_BUFFER_SIZE;
     s_display.framebuffer = malloc(s_display.buffer_size);
     if (s_display.framebuffer == NULL) {
         ESP_LOGE(TAG, "Failed to allocate framebuffer");
-        epd_deinit();
         return ESP_ERR_NO_MEM;
     }
+    s_display.panel_state = PANEL_OFF;
+
+    if (s_display.update_idle == NULL) {
+        s_display.update_idle = xSemaphoreCreateBinary();
+        s_display.update_queue = xQueueCreate(1, sizeof(display_update_request_t));
+        if (s_display.update_idle == NULL || s_display.update_queue == NULL) {
+            ESP_LOGE(TAG, "Failed to create display update queue");
+            free(s_display.framebuffer);
+            s_display.framebuffer = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+        xSemaphoreGive(s_display.update_idle);
+    }
 
     /* Initialize graphics context */
     graphics_init(CONFIG_DISPLAY_WIDTH, CONFIG_DISPLAY_HEIGHT);
@@ -76,12 +142,22 @@ void display_deinit(void)
         return;
     }
 
+    display_wait_update(portMAX_DELAY);
+
+    if (s_display.pending_frame != NULL) {
+        free(s_display.pending_frame);
+        s_display.pending_frame = NULL;
+    }
+
     if (s_display.framebuffer != NULL) {
         free(s_display.framebuffer);
         s_display.framebuffer = NULL;
     }
 
-    epd_deinit();
+    if (s_display.panel_state != PANEL_OFF) {
+        epd_deinit();
+        s_display.panel_state = PANEL_OFF;
+    }
     s_display.initialized = false;
 
     ESP_LOGI(TAG, "Display deinitialized");
@@ -110,6 +186,134 @@ int display_measure_text(const char *text)
     return measure_string_width(text);
 }
 
+/* Compare two frames word by word and return the byte-aligned bounding box
+ * of the changed pixels in physical coordinates. Returns false if identical. */
+static bool display_diff_frames(const uint32_t *old_frame, const uint32_t *new_frame, epd_window_t *window)
+{
+    int first_row = CONFIG_DISPLAY_HEIGHT;
+    int last_row = -1;
+    int first_col = DISPLAY_BYTES_PER_ROW;
+    int last_col = -1;
+
+    for (size_t word = 0; word < DISPLAY_BUFFER_WORDS; word++) {
+        if (old_frame[word] == new_frame[word]) {
+            continue;
+        }
+
+        /* Narrow the changed word down to its bytes */
+        const uint8_t *old_bytes = (const uint8_t *)&old_frame[word];
+        const uint8_t *new_bytes = (const uint8_t *)&new_frame[word];
+        for (size_t i = 0; i < sizeof(uint32_t); i++) {
+            if (old_bytes[i] == new_bytes[i]) {
+                continue;
+            }
+            int byte_index = (word * sizeof(uint32_t)) + i;
+            int row = byte_index / DISPLAY_BYTES_PER_ROW;
+            int col = byte_index % DISPLAY_BYTES_PER_ROW;
+
+            if (row < first_row) first_row = row;
+            if (row > last_row) last_row = row;
+            if (col < first_col) first_col = col;
+            if (col > last_col) last_col = col;
+        }
+    }
+
+    if (last_row < 0) {
+        return false;
+    }
+
+    window->x = first_col * 8;
+    window->y = first_row;
+    window->width = (last_col - first_col + 1) * 8;
+    window->height = last_row - first_row + 1;
+    return true;
+}
+
+#ifdef CONFIG_DISPLAY_LOG_FRAMES
+/* Print the frame as a plain PBM image in logical (as viewed) orientation,
+ * framed by markers so extract_frames.py can cut it out of a serial log */
+static void display_log_frame(const uint8_t *frame)
+{
+    static uint32_t frame_number;
+    char line[CONFIG_DISPLAY_HEIGHT + 1];
+
+    printf("-----BEGIN FRAME %lu-----\n", (unsigned long)frame_number++);
+    printf("P1\n%d %d\n", CONFIG_DISPLAY_HEIGHT, CONFIG_DISPLAY_WIDTH);
+    for (int y = 0; y < CONFIG_DISPLAY_WIDTH; y++) {
+        /* Logical (x, y) is physical (width - 1 - y, x); a set bit is white */
+        int phys_x = CONFIG_DISPLAY_WIDTH - 1 - y;
+        for (int x = 0; x < CONFIG_DISPLAY_HEIGHT; x++) {
+            uint8_t byte = frame[x * DISPLAY_BYTES_PER_ROW + phys_x / 8];
+            line[x] = (byte & (0x80 >> (phys_x % 8))) ? '0' : '1';
+        }
+        line[CONFIG_DISPLAY_HEIGHT] = '\0';
+        printf("%s\n", line);
+    }
+    printf("-----END FRAME-----\n");
+}
+#endif
+
+/* Bring the panel in line with the given frame. Callers serialize access. */
+static esp_err_t display_refresh_frame(const uint8_t *frame)
+{
+    esp_err_t ret;
+    epd_window_t window = {0};
+    const uint8_t *old_frame = (const uint8_t *)s_shown_frame;
+    bool full_refresh = !s_shown_valid || s_partial_count >= CONFIG_DISPLAY_FULL_REFRESH_INTERVAL;
+
+#ifdef CONFIG_DISPLAY_LOG_FRAMES
+    display_log_frame(frame);
+#endif
+
+    if (s_shown_valid && !display_diff_frames(s_shown_frame, (const uint32_t *)frame, &window)) {
+        s_refreshes_skipped++;
+        ESP_LOGI(TAG, "Frame unchanged, skipping refresh (%lu refreshes avoided since power-on)",
+                 s_refreshes_skipped);
+        wake_profiler_mark(WAKE_PHASE_DISPLAY_UPDATE);
+        return ESP_OK;
+    }
+
+    ret = display_panel_power_up();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    if (full_refresh) {
+        ret = epd_display_buffer(s_shown_valid ? old_frame : NULL, frame, s_display.buffer_size);
+        s_partial_count = 0;
+    } else {
+        ESP_LOGI(TAG, "Partial refresh: x=%d y=%d %dx%d", window.x, window.y, window.width, window.height);
+        ret = epd_display_window(old_frame, frame, s_display.buffer_size, &window);
+        s_partial_count++;
+    }
+
+    if (ret != ESP_OK) {
+        /* Panel content is unknown after a failed refresh */
+        s_shown_valid = false;
+        return ret;
+    }
+
+    memcpy(s_shown_frame, frame, s_display.buffer_size);
+    s_shown_valid = true;
+    wake_profiler_mark(WAKE_PHASE_DISPLAY_UPDATE);
+
+    return ESP_OK;
+}
+
+/* Put a powered panel to sleep. Callers hold update_idle. */
+static esp_err_t display_panel_sleep(void)
+{
+    if (s_display.panel_state != PANEL_ON) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = epd_sleep();
+    if (ret == ESP_OK) {
+        s_display.panel_state = PANEL_ASLEEP;
+    }
+    return ret;
+}
+
 esp_err_t display_update(void)
 {
     if (!s_display.initialized || s_display.framebuffer == NULL) {
@@ -117,7 +321,83 @@ esp_err_t display_update(void)
         return ESP_ERR_INVALID_STATE;
     }
 
-    return epd_display_buffer(s_display.framebuffer, s_display.buffer_size);
+    xSemaphoreTake(s_display.update_idle, portMAX_DELAY);
+    esp_err_t ret = display_refresh_frame(s_display.framebuffer);
+    xSemaphoreGive(s_display.update_idle);
+
+    return ret;
+}
+
+static void display_worker_task(void *pvParameter)
+{
+    display_update_request_t request;
+
+    while (true) {
+        xQueueReceive(s_display.update_queue, &request, portMAX_DELAY);
+
+        esp_err_t ret = display_refresh_frame(s_display.pending_frame);
+        if (request.sleep_after) {
+            esp_err_t sleep_ret = display_panel_sleep();
+            if (ret == ESP_OK) {
+                ret = sleep_ret;
+            }
+        }
+        xSemaphoreGive(s_display.update_idle);
+
+        if (request.callback != NULL) {
+            request.callback(ret, request.arg);
+        }
+    }
+}
+
+esp_err_t display_update_async(display_update_cb_t callback, void *arg, bool sleep_after)
+{
+    if (!s_display.initialized || s_display.framebuffer == NULL) {
+        ESP_LOGE(TAG, "Display not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (s_display.pending_frame == NULL) {
+        s_display.pending_frame = malloc(s_display.buffer_size);
+        if (s_display.pending_frame == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate pending frame");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (s_display.worker == NULL &&
+        xTaskCreatePinnedToCore(&display_worker_task, "Display Update", configMINIMAL_STACK_SIZE * 3,
+                                NULL, 1, &s_display.worker, 1) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start display update task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* One update in flight: wait for the previous one, then hand over a snapshot */
+    xSemaphoreTake(s_display.update_idle, portMAX_DELAY);
+    memcpy(s_display.pending_frame, s_display.framebuffer, s_display.buffer_size);
+
+    const display_update_request_t request = {
+        .callback = callback,
+        .arg = arg,
+        .sleep_after = sleep_after,
+    };
+    xQueueSend(s_display.update_queue, &request, portMAX_DELAY);
+
+    return ESP_OK;
+}
+
+esp_err_t display_wait_update(uint32_t timeout_ticks)
+{
+    if (s_display.update_idle == NULL) {
+        return ESP_OK;
+    }
+
+    if (xSemaphoreTake(s_display.update_idle, timeout_ticks) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    xSemaphoreGive(s_display.update_idle);
+
+    return ESP_OK;
 }
 
 esp_err_t display_sleep(void)
@@ -127,7 +407,11 @@ esp_err_t display_sleep(void)
         return ESP_ERR_INVALID_STATE;
     }
 
-    return epd_sleep();
+    xSemaphoreTake(s_display.update_idle, portMAX_DELAY);
+    esp_err_t ret = display_panel_sleep();
+    xSemaphoreGive(s_display.update_idle);
+
+    return ret;
 }
 
 esp_err_t display_wake(void)
@@ -137,7 +421,19 @@ esp_err_t display_wake(void)
         return ESP_ERR_INVALID_STATE;
     }
 
-    return epd_wake();
+    display_wait_update(portMAX_DELAY);
+
+    /* A panel that was never powered up is brought up by the next update */
+    if (s_display.panel_state == PANEL_OFF) {
+        return ESP_OK;
+    }
+
+    return display_panel_power_up();
+}
+
+uint32_t display_get_skipped_refreshes(void)
+{
+    return s_refreshes_skipped;
 }
 
 int display_get_width(void)
@@ -6,6 +6,7 @@
 #ifndef DISPLAY_H
 #define DISPLAY_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include "esp_err.h"
 
@@ -14,15 +15,26 @@
  */
 typedef struct display_ctx display_ctx_t;
 
+/**
+ * @brief Completion callback for display_update_async()
+ *
+ * Called from the display update task once the refresh has finished, and
+ * after the panel has been put to sleep if that was requested.
+ *
+ * @param result Result of the refresh (same values as display_update())
+ * @param arg User argument passed to display_update_async()
+ */
+typedef void (*display_update_cb_t)(esp_err_t result, void *arg);
+
 /**
  * @brief Initialize the display subsystem
  *
- * Initializes the e-paper hardware and allocates framebuffer.
+ * Allocates the framebuffer. The e-paper hardware is powered up by the first
+ * display_update() whose frame differs from the one already on the panel.
  *
  * @return
  *      - ESP_OK on success
  *      - ESP_ERR_NO_MEM if framebuffer allocation fails
- *      - ESP_FAIL if display initialization fails
  */
 esp_err_t display_init(void);
 
@@ -57,12 +69,45 @@ int display_measure_text(const char *text);
 /**
  * @brief Update the physical display with framebuffer contents
  *
+ * If the framebuffer matches the frame already on the panel (retained in RTC
+ * memory across deep sleep), the panel is neither powered up nor refreshed.
+ *
  * @return
  *      - ESP_OK on success
  *      - ESP_FAIL if display update fails
  */
 esp_err_t display_update(void);
 
+/**
+ * @brief Queue the framebuffer for display and return immediately
+ *
+ * The framebuffer is copied, so the caller can start drawing the next frame
+ * while the panel refreshes. Only one update is in flight at a time: if a
+ * previous asynchronous update is still running, this call waits for it
+ * before queuing. display_update(), display_sleep() and display_wake() also
+ * wait for a running asynchronous update.
+ *
+ * @param callback Called when the refresh completes (may be NULL)
+ * @param arg User argument passed to the callback
+ * @param sleep_after Put the panel to sleep once the refresh is done, as
+ *                    display_sleep() would, before the callback runs
+ * @return
+ *      - ESP_OK if the update was queued
+ *      - ESP_ERR_INVALID_STATE if the display is not initialized
+ *      - ESP_ERR_NO_MEM if the frame copy or update task cannot be allocated
+ */
+esp_err_t display_update_async(display_update_cb_t callback, void *arg, bool sleep_after);
+
+/**
+ * @brief Wait for a queued asynchronous update to finish
+ *
+ * @param timeout_ticks Maximum time to wait in FreeRTOS ticks
+ * @return
+ *      - ESP_OK if no update is running
+ *      - ESP_ERR_TIMEOUT if the update is still running after the timeout
+ */
+esp_err_t display_wait_update(uint32_t timeout_ticks);
+
 /**
  * @brief Put display into deep sleep mode
  *
@@ -81,6 +126,13 @@ esp_err_t display_sleep(void);
  */
 esp_err_t display_wake(void);
 
+/**
+ * @brief Get the number of refreshes skipped because the frame was unchanged
+ *
+ * @return Skipped refreshes since power-on (retained across deep sleep)
+ */
+uint32_t display_get_skipped_refreshes(void);
+
 /**
  * @brief Get display width
  *
@@ -6,12 +6,19 @@
  */
 
 #include "epd_driver_gdew0102t4.h"
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "driver/spi_master.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
 
 static const char *TAG = "epd_driver";
 
@@ -26,60 +33,246 @@ static const char *TAG = "epd_driver";
 #define UC8175_DSP         0x11   /* Data Stop */
 #define UC8175_DRF         0x12   /* Display Refresh */
 #define UC8175_DTM2        0x13   /* Data Start Transmission 2 (Red - not used) */
+#define UC8175_LUTW        0x23   /* White LUT (LUT from register) */
+#define UC8175_LUTB        0x24   /* Black LUT (LUT from register) */
 #define UC8175_PLL         0x30   /* PLL Control */
 #define UC8175_CDI         0x50   /* VCOM and Data Interval Setting */
 #define UC8175_TCON        0x60   /* TCON Setting */
 #define UC8175_TRES        0x61   /* Resolution Setting */
+#define UC8175_PTL         0x90   /* Partial Window */
+#define UC8175_PTIN        0x91   /* Partial In */
+#define UC8175_PTOUT       0x92   /* Partial Out */
 #define UC8175_PWS         0xE3   /* Power Saving */
 
+/* Register values for the full (OTP waveform) and fast (register waveform) refresh modes */
+#define EPD_PSR_FULL                        0x0F
+#define EPD_PSR_FAST                        0x6F
+#define EPD_PLL_FULL                        0x13
+#define EPD_PLL_FAST                        0x05
+#define EPD_CDI_FULL                        0x57
+#define EPD_CDI_FAST                        0xF2
+#define EPD_LUT_SIZE                        42
+
 /* SPI configuration constants */
-#define EPD_SPI_CLOCK_SPEED_HZ              (4 * 1000 * 1000)
+#define EPD_SPI_CLOCK_SPEED_HZ              (CONFIG_EPD_SPI_CLOCK_MHZ * 1000 * 1000)
 #define EPD_SPI_QUEUE_SIZE                  7
+#define EPD_DC_COMMAND                      0
+#define EPD_DC_DATA                         1
 #define EPD_RESET_DELAY_MS                  20
-#define EPD_BUSY_POLL_DELAY_MS              10
+#define EPD_BUSY_TIMEOUT_MS                 5000
+#define EPD_BUSY_ASSERT_TIMEOUT_MS          100
+
+/* Fast-update waveform: a single short phase drives only the pixels that change colour */
+static const uint8_t s_lut_w_fast[EPD_LUT_SIZE] = {
+    0x60, 0x01, 0x01, 0x00, 0x00, 0x01,
+};
+
+static const uint8_t s_lut_b_fast[EPD_LUT_SIZE] = {
+    0x90, 0x01, 0x01, 0x00, 0x00, 0x01,
+};
+
+/* One controller command with its (short) parameter list */
+typedef struct {
+    uint8_t cmd;
+    uint8_t len;
+    uint8_t data[4];
+} epd_cmd_t;
+
+/* Register setup before power-on: KW mode with OTP LUT, 30Hz frame rate */
+static const epd_cmd_t s_power_seq[] = {
+    { UC8175_PSR,  1, { EPD_PSR_FULL } },
+    { UC8175_PWR,  4, { 0x03, 0x00, 0x2B, 0x2B } },    /* VDH/VDL, VGH/VGL */
+    { UC8175_BTST, 1, { 0x3F } },                      /* 50ms, strength 4, 8kHz */
+    { UC8175_PLL,  1, { EPD_PLL_FULL } },
+};
+
+/* Register setup after power-on: VCOM/data interval, TCON, 80x128 resolution */
+static const epd_cmd_t s_panel_seq[] = {
+    { UC8175_CDI,  1, { EPD_CDI_FULL } },
+    { UC8175_TCON, 1, { 0x22 } },
+    { UC8175_TRES, 2, { 80, 128 } },
+};
+
+typedef enum {
+    EPD_MODE_FULL,
+    EPD_MODE_FAST,
+} epd_refresh_mode_t;
 
 /* Module state */
 static spi_device_handle_t s_spi_handle = NULL;
 static epd_config_t s_config = {0};
 static bool s_initialized = false;
+static epd_refresh_mode_t s_refresh_mode = EPD_MODE_FULL;
+static SemaphoreHandle_t s_busy_sem = NULL;
+
+/* Ring of queued SPI transactions; the DC level of each rides in its user field */
+static spi_transaction_t s_trans[EPD_SPI_QUEUE_SIZE];
+static size_t s_trans_head = 0;
+static size_t s_trans_pending = 0;
+
+static void IRAM_ATTR epd_spi_pre_transfer_cb(spi_transaction_t *t)
+{
+    gpio_set_level(s_config.pin_dc, (int)(intptr_t)t->user);
+}
+
+/* Reclaim the oldest transaction still owned by the SPI driver */
+static esp_err_t epd_spi_reclaim(void)
+{
+    spi_transaction_t *done = NULL;
+    esp_err_t ret = spi_device_get_trans_result(s_spi_handle, &done, portMAX_DELAY);
+    if (ret == ESP_OK) {
+        s_trans_pending--;
+    }
+    return ret;
+}
+
+/* Wait until every queued transfer has left the bus */
+static esp_err_t epd_spi_flush(void)
+{
+    while (s_trans_pending > 0) {
+        esp_err_t ret = epd_spi_reclaim();
+        if (ret != ESP_OK) return ret;
+    }
+    return ESP_OK;
+}
+
+/* Queue a DMA transfer without waiting for it. Payloads of up to 4 bytes are
+ * copied into the transaction; larger buffers must stay valid until the next
+ * epd_spi_flush(). With CONFIG_PM_ENABLE the SPI master driver holds an APB
+ * frequency lock per queued transaction, so only the transfers themselves keep
+ * the chip out of light sleep. */
+static esp_err_t epd_spi_queue(int dc, const uint8_t *data, size_t len)
+{
+    if (len == 0) {
+        return ESP_OK;
+    }
+
+    if (s_trans_pending == EPD_SPI_QUEUE_SIZE) {
+        esp_err_t ret = epd_spi_reclaim();
+        if (ret != ESP_OK) return ret;
+    }
+
+    spi_transaction_t *t = &s_trans[s_trans_head];
+    memset(t, 0, sizeof(*t));
+    t->length = len * 8;
+    t->user = (void *)(intptr_t)dc;
+    if (len <= sizeof(t->tx_data)) {
+        t->flags = SPI_TRANS_USE_TXDATA;
+        memcpy(t->tx_data, data, len);
+    } else {
+        t->tx_buffer = data;
+    }
+
+    esp_err_t ret = spi_device_queue_trans(s_spi_handle, t, portMAX_DELAY);
+    if (ret != ESP_OK) return ret;
+
+    s_trans_head = (s_trans_head + 1) % EPD_SPI_QUEUE_SIZE;
+    s_trans_pending++;
+    return ESP_OK;
+}
+
+/* Queue a command byte followed by its parameters */
+static esp_err_t epd_write(uint8_t cmd, const uint8_t *data, size_t len)
+{
+    esp_err_t ret = epd_spi_queue(EPD_DC_COMMAND, &cmd, 1);
+    if (ret == ESP_OK) {
+        ret = epd_spi_queue(EPD_DC_DATA, data, len);
+    }
+    if (ret != ESP_OK) {
+        /* Don't leave the caller's buffers referenced by in-flight transfers */
+        epd_spi_flush();
+    }
+    return ret;
+}
+
+static esp_err_t epd_write_byte(uint8_t cmd, uint8_t value)
+{
+    return epd_write(cmd, &value, 1);
+}
+
+static esp_err_t epd_write_sequence(const epd_cmd_t *seq, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        esp_err_t ret = epd_write(seq[i].cmd, seq[i].data, seq[i].len);
+        if (ret != ESP_OK) return ret;
+    }
+    return ESP_OK;
+}
+
+static void IRAM_ATTR epd_busy_isr_handler(void *arg)
+{
+    /* Level interrupt: mask it until the next wait re-arms it */
+    gpio_intr_disable(s_config.pin_busy);
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    xSemaphoreGiveFromISR(s_busy_sem, &higher_priority_task_woken);
+    if (higher_priority_task_woken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/* Block until the BUSY pin reaches the given level. The task waits on a
+ * semaphore signalled by a level interrupt, so the CPU is free to idle (and
+ * light-sleep when power management is enabled) instead of polling. */
+static bool epd_wait_busy_level(int level, uint32_t timeout_ms)
+{
+    const gpio_int_type_t intr_type = level ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL;
+
+    xSemaphoreTake(s_busy_sem, 0);
+    gpio_set_intr_type(s_config.pin_busy, intr_type);
+#ifdef CONFIG_PM_ENABLE
+    gpio_wakeup_enable(s_config.pin_busy, intr_type);
+#endif
+    gpio_intr_enable(s_config.pin_busy);
+
+    bool reached = gpio_get_level(s_config.pin_busy) == level ||
+                   xSemaphoreTake(s_busy_sem, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+
+    gpio_intr_disable(s_config.pin_busy);
+#ifdef CONFIG_PM_ENABLE
+    gpio_wakeup_disable(s_config.pin_busy);
+#endif
+
+    return reached;
+}
 
 static esp_err_t epd_wait_idle(void)
 {
-    const int max_wait_ms = 5000;  /* 5 second timeout */
-    int elapsed_ms = 0;
+    esp_err_t ret = epd_spi_flush();
+    if (ret != ESP_OK) return ret;
 
     /* Wait for BUSY to go HIGH (inverted logic: LOW=busy, HIGH=idle) */
-    while (gpio_get_level(s_config.pin_busy) == 0) {
-        vTaskDelay(pdMS_TO_TICKS(EPD_BUSY_POLL_DELAY_MS));
-        elapsed_ms += EPD_BUSY_POLL_DELAY_MS;
-
-        if (elapsed_ms >= max_wait_ms) {
-            ESP_LOGE(TAG, "Timeout waiting for display (BUSY pin stuck LOW)");
-            return ESP_ERR_TIMEOUT;
-        }
+    if (!epd_wait_busy_level(1, EPD_BUSY_TIMEOUT_MS)) {
+        ESP_LOGE(TAG, "Timeout waiting for display (BUSY pin stuck LOW)");
+        return ESP_ERR_TIMEOUT;
     }
 
     return ESP_OK;
 }
 
-static esp_err_t epd_send_command(uint8_t cmd)
+/* Wait for a command that drives BUSY (PON, DRF) to start and then finish */
+static esp_err_t epd_wait_busy_cycle(void)
 {
-    gpio_set_level(s_config.pin_dc, 0);
-    spi_transaction_t t = {
-        .length = 8,
-        .tx_buffer = &cmd,
-    };
-    return spi_device_polling_transmit(s_spi_handle, &t);
+    esp_err_t ret = epd_spi_flush();
+    if (ret != ESP_OK) return ret;
+
+    /* BUSY drops shortly after the command; don't mistake the old idle level for completion */
+    epd_wait_busy_level(0, EPD_BUSY_ASSERT_TIMEOUT_MS);
+    return epd_wait_idle();
 }
 
-static esp_err_t epd_send_data(uint8_t data)
+static esp_err_t epd_refresh_and_wait(const char *mode_name)
 {
-    gpio_set_level(s_config.pin_dc, 1);
-    spi_transaction_t t = {
-        .length = 8,
-        .tx_buffer = &data,
-    };
-    return spi_device_polling_transmit(s_spi_handle, &t);
+    int64_t start_us = esp_timer_get_time();
+
+    esp_err_t ret = epd_write(UC8175_DRF, NULL, 0);
+    if (ret != ESP_OK) return ret;
+
+    ret = epd_wait_busy_cycle();
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "%s refresh took %lld ms", mode_name, (esp_timer_get_time() - start_us) / 1000);
+    }
+    return ret;
 }
 
 static void epd_reset(void)
@@ -90,6 +283,19 @@ static void epd_reset(void)
     vTaskDelay(pdMS_TO_TICKS(EPD_RESET_DELAY_MS));
 }
 
+static esp_err_t epd_spi_add_device(int clock_speed_hz)
+{
+    spi_device_interface_config_t dev_config = {
+        .clock_speed_hz = clock_speed_hz,
+        .mode = 0,
+        .spics_io_num = s_config.pin_cs,
+        .queue_size = EPD_SPI_QUEUE_SIZE,
+        .pre_cb = epd_spi_pre_transfer_cb,
+    };
+
+    return spi_bus_add_device(SPI2_HOST, &dev_config, &s_spi_handle);
+}
+
 static esp_err_t epd_hardware_init(void)
 {
     esp_err_t ret;
@@ -126,7 +332,7 @@ static esp_err_t epd_hardware_init(void)
         return ret;
     }
 
-    /* Configure input GPIO pin (BUSY) */
+    /* Configure input GPIO pin (BUSY), interrupt armed per wait */
     io_conf.pin_bit_mask = (1ULL << s_config.pin_busy);
     io_conf.mode = GPIO_MODE_INPUT;
     ret = gpio_config(&io_conf);
@@ -135,6 +341,30 @@ static esp_err_t epd_hardware_init(void)
         return ret;
     }
 
+    if (s_busy_sem == NULL) {
+        s_busy_sem = xSemaphoreCreateBinary();
+        if (s_busy_sem == NULL) {
+            ESP_LOGE(TAG, "Failed to create BUSY semaphore");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    /* The ISR service may already be installed by another module */
+    ret = gpio_install_isr_service(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Failed to install GPIO ISR service");
+        return ret;
+    }
+    gpio_intr_disable(s_config.pin_busy);
+    ret = gpio_isr_handler_add(s_config.pin_busy, epd_busy_isr_handler, NULL);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add BUSY interrupt handler");
+        return ret;
+    }
+#ifdef CONFIG_PM_ENABLE
+    esp_sleep_enable_gpio_wakeup();
+#endif
+
     /* Configure SPI bus */
     spi_bus_config_t bus_config = {
         .mosi_io_num = s_config.pin_mosi,
@@ -151,15 +381,7 @@ static esp_err_t epd_hardware_init(void)
         return ret;
     }
 
-    /* Configure SPI device */
-    spi_device_interface_config_t dev_config = {
-        .clock_speed_hz = EPD_SPI_CLOCK_SPEED_HZ,
-        .mode = 0,
-        .spics_io_num = s_config.pin_cs,
-        .queue_size = EPD_SPI_QUEUE_SIZE,
-    };
-
-    ret = spi_bus_add_device(SPI2_HOST, &dev_config, &s_spi_handle);
+    ret = epd_spi_add_device(EPD_SPI_CLOCK_SPEED_HZ);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to add SPI device");
         spi_bus_free(SPI2_HOST);
@@ -177,66 +399,102 @@ static esp_err_t epd_display_init_sequence(void)
     epd_reset();
     vTaskDelay(pdMS_TO_TICKS(20));
 
-    /* Panel Setting Register - KW mode, LUT from register */
-    ret = epd_send_command(UC8175_PSR);
-    if (ret != ESP_OK) return ret;
-    ret = epd_send_data(0x0F);
-    if (ret != ESP_OK) return ret;
-
-    /* Power Setting */
-    ret = epd_send_command(UC8175_PWR);
-    if (ret != ESP_OK) return ret;
-    ret = epd_send_data(0x03);  /* VDH/VDL */
+    /* Power settings are queued back to back; only PON needs to wait on BUSY */
+    ret = epd_write_sequence(s_power_seq, sizeof(s_power_seq) / sizeof(s_power_seq[0]));
     if (ret != ESP_OK) return ret;
-    ret = epd_send_data(0x00);  /* VGH/VGL */
+    ret = epd_write(UC8175_PON, NULL, 0);
     if (ret != ESP_OK) return ret;
-    ret = epd_send_data(0x2B);
-    if (ret != ESP_OK) return ret;
-    ret = epd_send_data(0x2B);
+    ret = epd_wait_busy_cycle();
     if (ret != ESP_OK) return ret;
 
-    /* Booster Soft Start - 50ms, strength 4, 8kHz */
-    ret = epd_send_command(UC8175_BTST);
+    ret = epd_write_sequence(s_panel_seq, sizeof(s_panel_seq) / sizeof(s_panel_seq[0]));
     if (ret != ESP_OK) return ret;
-    ret = epd_send_data(0x3F);
+    ret = epd_spi_flush();
     if (ret != ESP_OK) return ret;
 
-    /* PLL Control - 30Hz frame rate */
-    ret = epd_send_command(UC8175_PLL);
-    if (ret != ESP_OK) return ret;
-    ret = epd_send_data(0x13);
-    if (ret != ESP_OK) return ret;
+    s_refresh_mode = EPD_MODE_FULL;
 
-    /* Power ON and wait for ready */
-    ret = epd_send_command(UC8175_PON);
-    if (ret != ESP_OK) return ret;
-    vTaskDelay(pdMS_TO_TICKS(5));
-    ret = epd_wait_idle();
-    if (ret != ESP_OK) return ret;
+    return ESP_OK;
+}
 
-    /* VCOM and Data Interval Setting */
-    ret = epd_send_command(UC8175_CDI);
-    if (ret != ESP_OK) return ret;
-    ret = epd_send_data(0x57);
-    if (ret != ESP_OK) return ret;
+static esp_err_t epd_set_refresh_mode(epd_refresh_mode_t mode)
+{
+    if (mode == s_refresh_mode) {
+        return ESP_OK;
+    }
 
-    /* TCON Setting */
-    ret = epd_send_command(UC8175_TCON);
-    if (ret != ESP_OK) return ret;
-    ret = epd_send_data(0x22);
-    if (ret != ESP_OK) return ret;
+    const bool fast = (mode == EPD_MODE_FAST);
+    esp_err_t ret;
 
-    /* Resolution Setting: 80x128 */
-    ret = epd_send_command(UC8175_TRES);
+    /* Fast mode loads the waveform from the LUT registers instead of OTP */
+    ret = epd_write_byte(UC8175_PSR, fast ? EPD_PSR_FAST : EPD_PSR_FULL);
     if (ret != ESP_OK) return ret;
-    ret = epd_send_data(80);
+    ret = epd_write_byte(UC8175_PLL, fast ? EPD_PLL_FAST : EPD_PLL_FULL);
     if (ret != ESP_OK) return ret;
-    ret = epd_send_data(128);
+    ret = epd_write_byte(UC8175_CDI, fast ? EPD_CDI_FAST : EPD_CDI_FULL);
     if (ret != ESP_OK) return ret;
 
+    if (fast) {
+        ret = epd_write(UC8175_LUTW, s_lut_w_fast, sizeof(s_lut_w_fast));
+        if (ret != ESP_OK) return ret;
+        ret = epd_write(UC8175_LUTB, s_lut_b_fast, sizeof(s_lut_b_fast));
+        if (ret != ESP_OK) return ret;
+    }
+
+    s_refresh_mode = mode;
     return ESP_OK;
 }
 
+#ifdef CONFIG_EPD_SPI_BENCHMARK
+/* Time the register setup plus one full frame (both data planes) at a range of
+ * SPI clocks, then restore the configured clock. No DRF is sent, so the panel
+ * content doesn't change. */
+static esp_err_t epd_spi_benchmark(void)
+{
+    static const int clocks_mhz[] = { 1, 2, 4, 8, 10, 16, 20 };
+    const size_t frame_size = (s_config.width * s_config.height) / 8;
+
+    uint8_t *frame = heap_caps_malloc(frame_size, MALLOC_CAP_DMA);
+    if (frame == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate benchmark frame");
+        return ESP_ERR_NO_MEM;
+    }
+    memset(frame, 0xFF, frame_size);
+
+    esp_err_t ret = ESP_OK;
+    for (size_t i = 0; i < sizeof(clocks_mhz) / sizeof(clocks_mhz[0]) && ret == ESP_OK; i++) {
+        spi_bus_remove_device(s_spi_handle);
+        ret = epd_spi_add_device(clocks_mhz[i] * 1000 * 1000);
+        if (ret != ESP_OK) break;
+
+        int64_t start_us = esp_timer_get_time();
+        ret = epd_write_sequence(s_power_seq, sizeof(s_power_seq) / sizeof(s_power_seq[0]));
+        if (ret == ESP_OK) ret = epd_write_sequence(s_panel_seq, sizeof(s_panel_seq) / sizeof(s_panel_seq[0]));
+        if (ret == ESP_OK) ret = epd_write(UC8175_DTM1, frame, frame_size);
+        if (ret == ESP_OK) ret = epd_write(UC8175_DTM2, frame, frame_size);
+        if (ret == ESP_OK) ret = epd_write(UC8175_DSP, NULL, 0);
+        if (ret == ESP_OK) ret = epd_spi_flush();
+
+        if (ret == ESP_OK) {
+            ESP_LOGI(TAG, "SPI benchmark: %2d MHz, init + frame sent in %lld us",
+                     clocks_mhz[i], esp_timer_get_time() - start_us);
+        }
+    }
+
+    free(frame);
+
+    spi_bus_remove_device(s_spi_handle);
+    esp_err_t restore_ret = epd_spi_add_device(EPD_SPI_CLOCK_SPEED_HZ);
+    if (restore_ret != ESP_OK) {
+        s_spi_handle = NULL;
+        ESP_LOGE(TAG, "Failed to restore SPI device after benchmark");
+        return restore_ret;
+    }
+
+    return ret;
+}
+#endif
+
 esp_err_t epd_init(const epd_config_t *config)
 {
     if (config == NULL) {
@@ -269,6 +527,17 @@ esp_err_t epd_init(const epd_config_t *config)
         return ret;
     }
 
+#ifdef CONFIG_EPD_SPI_BENCHMARK
+    ret = epd_spi_benchmark();
+    if (s_spi_handle == NULL) {
+        ESP_LOGE(TAG, "SPI device lost during benchmark");
+        return ret;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "SPI benchmark failed: %s", esp_err_to_name(ret));
+    }
+#endif
+
     s_initialized = true;
     ESP_LOGI(TAG, "E-Paper display initialized successfully");
 
@@ -281,7 +550,10 @@ esp_err_t epd_deinit(void)
         return ESP_OK;
     }
 
+    gpio_isr_handler_remove(s_config.pin_busy);
+
     if (s_spi_handle != NULL) {
+        epd_spi_flush();
         spi_bus_remove_device(s_spi_handle);
         s_spi_handle = NULL;
     }
@@ -294,7 +566,7 @@ esp_err_t epd_deinit(void)
     return ESP_OK;
 }
 
-esp_err_t epd_display_buffer(const uint8_t *buffer, size_t size)
+esp_err_t epd_display_buffer(const uint8_t *old_buffer, const uint8_t *buffer, size_t size)
 {
     if (!s_initialized) {
         ESP_LOGE(TAG, "E-Paper display not initialized");
@@ -312,50 +584,124 @@ esp_err_t epd_display_buffer(const uint8_t *buffer, size_t size)
         return ESP_ERR_INVALID_ARG;
     }
 
-    esp_err_t ret;
-
-    /* Write to DTM1 (old buffer) */
-    ret = epd_send_command(UC8175_DTM1);
+    esp_err_t ret = epd_set_refresh_mode(EPD_MODE_FULL);
     if (ret != ESP_OK) return ret;
 
-    gpio_set_level(s_config.pin_dc, 1);
-    spi_transaction_t t1 = {
-        .length = size * 8,
-        .tx_buffer = buffer,
-    };
-    ret = spi_device_polling_transmit(s_spi_handle, &t1);
+    /* Write to DTM1 (old buffer) */
+    ret = epd_write(UC8175_DTM1, old_buffer != NULL ? old_buffer : buffer, size);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to send DTM1 data");
         return ret;
     }
 
     /* Write to DTM2 (new buffer) */
-    ret = epd_send_command(UC8175_DTM2);
-    if (ret != ESP_OK) return ret;
-
-    gpio_set_level(s_config.pin_dc, 1);
-    spi_transaction_t t2 = {
-        .length = size * 8,
-        .tx_buffer = buffer,
-    };
-    ret = spi_device_polling_transmit(s_spi_handle, &t2);
+    ret = epd_write(UC8175_DTM2, buffer, size);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to send DTM2 data");
         return ret;
     }
 
     /* Data Stop */
-    ret = epd_send_command(UC8175_DSP);
+    ret = epd_write(UC8175_DSP, NULL, 0);
     if (ret != ESP_OK) return ret;
 
-    /* Trigger display refresh */
-    ret = epd_send_command(UC8175_DRF);
-    if (ret != ESP_OK) return ret;
+    /* Trigger display refresh and wait for it to complete */
+    return epd_refresh_and_wait("Full");
+}
 
-    vTaskDelay(pdMS_TO_TICKS(100));
+esp_err_t epd_display_window(const uint8_t *old_buffer, const uint8_t *buffer, size_t size,
+                             const epd_window_t *window)
+{
+    if (!s_initialized) {
+        ESP_LOGE(TAG, "E-Paper display not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
 
-    /* Wait for refresh to complete */
-    return epd_wait_idle();
+    if (buffer == NULL || window == NULL) {
+        ESP_LOGE(TAG, "Buffer and window cannot be NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t expected_size = (s_config.width * s_config.height) / 8;
+    if (size != expected_size) {
+        ESP_LOGE(TAG, "Invalid buffer size: %d (expected %d)", size, expected_size);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* The controller addresses columns in whole bytes */
+    if ((window->x % 8) != 0 || (window->width % 8) != 0 || window->width == 0 || window->height == 0 ||
+        window->x + window->width > s_config.width || window->y + window->height > s_config.height) {
+        ESP_LOGE(TAG, "Invalid window: x=%d y=%d w=%d h=%d",
+                 window->x, window->y, window->width, window->height);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Gather the window rows of both images into contiguous blocks */
+    const size_t bytes_per_row = s_config.width / 8;
+    const size_t window_row_bytes = window->width / 8;
+    const size_t window_size = window_row_bytes * window->height;
+    uint8_t *window_buffer = malloc(window_size * 2);
+    if (window_buffer == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate window buffer");
+        return ESP_ERR_NO_MEM;
+    }
+    uint8_t *old_window = window_buffer;
+    uint8_t *new_window = window_buffer + window_size;
+
+    if (old_buffer == NULL) {
+        old_buffer = buffer;
+    }
+
+    for (uint16_t row = 0; row < window->height; row++) {
+        size_t offset = (window->y + row) * bytes_per_row + (window->x / 8);
+        memcpy(&old_window[row * window_row_bytes], &old_buffer[offset], window_row_bytes);
+        memcpy(&new_window[row * window_row_bytes], &buffer[offset], window_row_bytes);
+    }
+
+    esp_err_t ret = epd_set_refresh_mode(EPD_MODE_FAST);
+    if (ret != ESP_OK) goto cleanup;
+
+    ret = epd_write(UC8175_PTIN, NULL, 0);
+    if (ret != ESP_OK) goto cleanup;
+
+    /* Partial Window: HRST/HRED (byte aligned), VRST/VRED, scan inside window only */
+    const uint8_t ptl[] = {
+        window->x,
+        window->x + window->width - 1,
+        window->y,
+        window->y + window->height - 1,
+        0x01,
+    };
+    ret = epd_write(UC8175_PTL, ptl, sizeof(ptl));
+    if (ret != ESP_OK) goto cleanup;
+
+    ret = epd_write(UC8175_DTM1, old_window, window_size);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send DTM1 window data");
+        goto cleanup;
+    }
+
+    ret = epd_write(UC8175_DTM2, new_window, window_size);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send DTM2 window data");
+        goto cleanup;
+    }
+
+    ret = epd_write(UC8175_DSP, NULL, 0);
+    if (ret != ESP_OK) goto cleanup;
+
+    ret = epd_refresh_and_wait("Partial");
+    if (ret != ESP_OK) goto cleanup;
+
+    ret = epd_write(UC8175_PTOUT, NULL, 0);
+
+cleanup:
+    /* The window blocks are still referenced by queued transfers until flushed */
+    if (epd_spi_flush() != ESP_OK && ret == ESP_OK) {
+        ret = ESP_FAIL;
+    }
+    free(window_buffer);
+    return ret;
 }
 
 esp_err_t epd_clear(void)
@@ -373,7 +719,7 @@ esp_err_t epd_clear(void)
     }
 
     memset(white_buffer, 0xFF, buffer_size);
-    esp_err_t ret = epd_display_buffer(white_buffer, buffer_size);
+    esp_err_t ret = epd_display_buffer(NULL, white_buffer, buffer_size);
     free(white_buffer);
 
     return ret;
@@ -389,13 +735,15 @@ esp_err_t epd_sleep(void)
     esp_err_t ret = epd_wait_idle();
     if (ret != ESP_OK) return ret;
 
-    ret = epd_send_command(UC8175_POF);
+    ret = epd_write(UC8175_POF, NULL, 0);
+    if (ret != ESP_OK) return ret;
+    ret = epd_spi_flush();
     if (ret != ESP_OK) return ret;
     vTaskDelay(pdMS_TO_TICKS(20));
 
-    ret = epd_send_command(UC8175_DSLP);
+    ret = epd_write_byte(UC8175_DSLP, 0xA5);
     if (ret != ESP_OK) return ret;
-    ret = epd_send_data(0xA5);
+    ret = epd_spi_flush();
     if (ret != ESP_OK) return ret;
     vTaskDelay(pdMS_TO_TICKS(10));
 
@@ -24,6 +24,18 @@ typedef struct {
     uint16_t height;        /**< Display height in pixels */
 } epd_config_t;
 
+/**
+ * @brief Rectangular region of the panel in physical coordinates
+ *
+ * x and width must be multiples of 8 (the controller addresses whole bytes).
+ */
+typedef struct {
+    uint16_t x;             /**< Left column in pixels */
+    uint16_t y;             /**< Top row in pixels */
+    uint16_t width;         /**< Width in pixels */
+    uint16_t height;        /**< Height in pixels */
+} epd_window_t;
+
 /**
  * @brief Initialize the E-Paper display
  *
@@ -47,6 +59,7 @@ esp_err_t epd_deinit(void);
 /**
  * @brief Display a buffer on the E-Paper screen
  *
+ * @param old_buffer Frame currently shown on the panel, or NULL if unknown
  * @param buffer Pointer to the framebuffer (1 bit per pixel)
  * @param size Size of the buffer in bytes
  * @return
@@ -54,7 +67,27 @@ esp_err_t epd_deinit(void);
  *      - ESP_ERR_INVALID_ARG if buffer is NULL
  *      - ESP_FAIL if display operation fails
  */
-esp_err_t epd_display_buffer(const uint8_t *buffer, size_t size);
+esp_err_t epd_display_buffer(const uint8_t *old_buffer, const uint8_t *buffer, size_t size);
+
+/**
+ * @brief Refresh only a rectangular window using the fast-update waveform
+ *
+ * Only the window rows of the framebuffer are sent to the controller. Pixels
+ * outside the window keep their current state. Repeated fast updates leave
+ * ghosting, so callers should interleave full refreshes.
+ *
+ * @param old_buffer Full frame currently shown on the panel, or NULL if unknown
+ * @param buffer Pointer to the full framebuffer (1 bit per pixel)
+ * @param size Size of the buffer in bytes
+ * @param window Region to update (x and width byte aligned)
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if buffer, size or window is invalid
+ *      - ESP_ERR_NO_MEM if the window buffer cannot be allocated
+ *      - ESP_FAIL if display operation fails
+ */
+esp_err_t epd_display_window(const uint8_t *old_buffer, const uint8_t *buffer, size_t size,
+                             const epd_window_t *window);
 
 /**
  * @brief Clear the E-Paper display to white
@@ -181,3 +181,81 @@ const font_glyph_9x15_t font_ua_9x15[] = {
 };
 
 const size_t font_ua_9x15_count = 72;
+
+/* Position in font_ua_9x15 plus one for each codepoint of U+0400-U+04FF, 0 if no glyph.
+ * Keep in sync with font_ua_9x15 when glyphs are added; host_test/test_glyphs.c
+ * checks both directions. */
+const uint8_t font_ua_9x15_index[FONT_UA_INDEX_SIZE] = {
+    [0x04] = 64 + 1, // Є
+    [0x06] = 65 + 1, // І
+    [0x07] = 66 + 1, // Ї
+    [0x10] =  0 + 1, // А
+    [0x11] =  1 + 1, // Б
+    [0x12] =  2 + 1, // В
+    [0x13] =  3 + 1, // Г
+    [0x14] =  4 + 1, // Д
+    [0x15] =  5 + 1, // Е
+    [0x16] =  6 + 1, // Ж
+    [0x17] =  7 + 1, // З
+    [0x18] =  8 + 1, // И
+    [0x19] =  9 + 1, // Й
+    [0x1A] = 10 + 1, // К
+    [0x1B] = 11 + 1, // Л
+    [0x1C] = 12 + 1, // М
+    [0x1D] = 13 + 1, // Н
+    [0x1E] = 14 + 1, // О
+    [0x1F] = 15 + 1, // П
+    [0x20] = 16 + 1, // Р
+    [0x21] = 17 + 1, // С
+    [0x22] = 18 + 1, // Т
+    [0x23] = 19 + 1, // У
+    [0x24] = 20 + 1, // Ф
+    [0x25] = 21 + 1, // Х
+    [0x26] = 22 + 1, // Ц
+    [0x27] = 23 + 1, // Ч
+    [0x28] = 24 + 1, // Ш
+    [0x29] = 25 + 1, // Щ
+    [0x2A] = 26 + 1, // Ъ
+    [0x2B] = 27 + 1, // Ы
+    [0x2C] = 28 + 1, // Ь
+    [0x2D] = 29 + 1, // Э
+    [0x2E] = 30 + 1, // Ю
+    [0x2F] = 31 + 1, // Я
+    [0x30] = 32 + 1, // а
+    [0x31] = 33 + 1, // б
+    [0x32] = 34 + 1, // в
+    [0x33] = 35 + 1, // г
+    [0x34] = 36 + 1, // д
+    [0x35] = 37 + 1, // е
+    [0x36] = 38 + 1, // ж
+    [0x37] = 39 + 1, // з
+    [0x38] = 40 + 1, // и
+    [0x39] = 41 + 1, // й
+    [0x3A] = 42 + 1, // к
+    [0x3B] = 43 + 1, // л
+    [0x3C] = 44 + 1, // м
+    [0x3D] = 45 + 1, // н
+    [0x3E] = 46 + 1, // о
+    [0x3F] = 47 + 1, // п
+    [0x40] = 48 + 1, // р
+    [0x41] = 49 + 1, // с
+    [0x42] = 50 + 1, // т
+    [0x43] = 51 + 1, // у
+    [0x44] = 52 + 1, // ф
+    [0x45] = 53 + 1, // х
+    [0x46] = 54 + 1, // ц
+    [0x47] = 55 + 1, // ч
+    [0x48] = 56 + 1, // ш
+    [0x49] = 57 + 1, // щ
+    [0x4A] = 58 + 1, // ъ
+    [0x4B] = 59 + 1, // ы
+    [0x4C] = 60 + 1, // ь
+    [0x4D] = 61 + 1, // э
+    [0x4E] = 62 + 1, // ю
+    [0x4F] = 63 + 1, // я
+    [0x54] = 68 + 1, // є
+    [0x56] = 69 + 1, // і
+    [0x57] = 70 + 1, // ї
+    [0x90] = 71 + 1, // Ґ
+    [0x91] = 67 + 1, // ґ
+};
@@ -19,4 +19,10 @@ typedef struct {
 extern const font_glyph_9x15_t font_ua_9x15[];
 extern const size_t font_ua_9x15_count;
 
+/* Direct index of font_ua_9x15 for the Cyrillic block U+0400-U+04FF */
+#define FONT_UA_INDEX_FIRST 0x0400
+#define FONT_UA_INDEX_SIZE  256
+
+extern const uint8_t font_ua_9x15_index[FONT_UA_INDEX_SIZE];
+
 #endif /* FONT_9X15_H */
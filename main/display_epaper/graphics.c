@@ -10,10 +10,25 @@
  */
 
 #include "graphics.h"
+#include "sdkconfig.h"
 #include "fonts/font_9x15.h"
 #include "utf8.h"
 #include "global_constants.h"
 
+#ifdef CONFIG_DISPLAY_GLYPH_SELF_CHECK
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+
+static const char *TAG = "graphics";
+
+static void graphics_self_check(void);
+#endif
+
+/* Glyph columns are 15 pixels tall, stored in bits 0-14 */
+#define GLYPH_COLUMN_MASK   0x7FFF
+
 static struct {
     int phys_width;      /* Physical display width */
     int phys_height;     /* Physical display height */
@@ -29,6 +44,10 @@ void graphics_init(int width, int height)
     s_graphics.logical_width = height;   /* Rotated 90 degrees */
     s_graphics.logical_height = width;
     s_graphics.bytes_per_row = width / 8;
+
+#ifdef CONFIG_DISPLAY_GLYPH_SELF_CHECK
+    graphics_self_check();
+#endif
 }
 
 static const uint16_t *get_glyph(uint32_t codepoint)
@@ -37,10 +56,10 @@ static const uint16_t *get_glyph(uint32_t codepoint)
         return font_9x15[codepoint - 32];
     }
 
-    for (size_t i = 0; i < font_ua_9x15_count; i++) {
-        if (font_ua_9x15[i].codepoint == codepoint) {
-            return font_ua_9x15[i].glyph;
-        }
+    /* Every non-ASCII glyph in the font lies in the Cyrillic block */
+    uint32_t offset = codepoint - FONT_UA_INDEX_FIRST;
+    if (offset < FONT_UA_INDEX_SIZE && font_ua_9x15_index[offset] != 0) {
+        return font_ua_9x15[font_ua_9x15_index[offset] - 1].glyph;
     }
 
     return NULL;
@@ -75,7 +94,9 @@ void draw_pixel(uint8_t *framebuffer, int x, int y, uint8_t color)
     draw_pixel_physical(framebuffer, phys_x, phys_y, color);
 }
 
-static void draw_glyph(uint8_t *framebuffer, int x, int y, const uint16_t *glyph, uint8_t color)
+#ifdef CONFIG_DISPLAY_GLYPH_SELF_CHECK
+/* Reference renderer: one draw_pixel() per set bit. Kept to validate draw_glyph(). */
+static void draw_glyph_per_pixel(uint8_t *framebuffer, int x, int y, const uint16_t *glyph, uint8_t color)
 {
     /* Font is 9 columns x 15 rows
      * Each column is a uint16_t where bits 0-14 represent vertical pixels
@@ -93,6 +114,59 @@ static void draw_glyph(uint8_t *framebuffer, int x, int y, const uint16_t *glyph
         }
     }
 }
+#endif
+
+static void draw_glyph(uint8_t *framebuffer, int x, int y, const uint16_t *glyph, uint8_t color)
+{
+    /* After the 90-degree rotation glyph column `col` is physical row x + col,
+     * and logical y + row is physical x = phys_width - 1 - (y + row). With
+     * phys_width a multiple of 8 that pixel is bit (y + row) % 8 of byte
+     * bytes_per_row - 1 - (y + row) / 8, so a whole column is one shifted
+     * 15-bit value spread over at most 3 bytes of the row, walking backwards.
+     */
+    const int bytes_per_row = s_graphics.bytes_per_row;
+
+    /* Clip once per glyph: visible columns and visible bits within a column */
+    int col_start = x < 0 ? -x : 0;
+    int col_end = s_graphics.logical_width - x;
+    if (col_end > FONT_CHAR_WIDTH) {
+        col_end = FONT_CHAR_WIDTH;
+    }
+
+    uint32_t row_mask = GLYPH_COLUMN_MASK;
+    if (y < 0) {
+        row_mask = y > -FONT_CHAR_HEIGHT ? (row_mask >> -y) << -y : 0;
+    }
+    if (y + FONT_CHAR_HEIGHT > s_graphics.logical_height) {
+        int visible = s_graphics.logical_height - y;
+        row_mask &= visible > 0 ? (1UL << visible) - 1 : 0;
+    }
+
+    if (col_start >= col_end || row_mask == 0) {
+        return;
+    }
+
+    /* First byte touched (counting from the end of the row) and shift into it */
+    const int first_byte = y < 0 ? 0 : y / 8;
+
+    for (int col = col_start; col < col_end; col++) {
+        uint32_t bits = glyph[col] & row_mask;
+        if (bits == 0) {
+            continue;
+        }
+        bits = y < 0 ? bits >> -y : bits << (y % 8);
+
+        uint8_t *row_end = &framebuffer[(x + col + 1) * bytes_per_row - 1];
+        for (int i = first_byte; bits != 0 && i < bytes_per_row; i++, bits >>= 8) {
+            uint8_t *byte = row_end - i;
+            if (color) {
+                *byte |= (uint8_t)bits;
+            } else {
+                *byte &= (uint8_t)~bits;
+            }
+        }
+    }
+}
 
 void draw_string(uint8_t *framebuffer, int x, int y, const char *str, uint8_t color)
 {
@@ -161,3 +235,63 @@ int measure_string_width(const char *str)
 
     return max_width;
 }
+
+#ifdef CONFIG_DISPLAY_GLYPH_SELF_CHECK
+/* Render every glyph at clipped and unclipped positions with both renderers and compare */
+static bool self_check_glyph(uint8_t *expected, uint8_t *actual, size_t size, const uint16_t *glyph)
+{
+    static const int offsets_x[] = { -8, -3, 0, 5, 61, 120, 124 };
+    static const int offsets_y[] = { -14, -7, -1, 0, 3, 8, 33, 65, 70, 79 };
+
+    for (size_t ix = 0; ix < sizeof(offsets_x) / sizeof(offsets_x[0]); ix++) {
+        for (size_t iy = 0; iy < sizeof(offsets_y) / sizeof(offsets_y[0]); iy++) {
+            for (uint8_t color = 0; color <= 1; color++) {
+                memset(expected, color ? 0x00 : 0xFF, size);
+                memset(actual, color ? 0x00 : 0xFF, size);
+                draw_glyph_per_pixel(expected, offsets_x[ix], offsets_y[iy], glyph, color);
+                draw_glyph(actual, offsets_x[ix], offsets_y[iy], glyph, color);
+                if (memcmp(expected, actual, size) != 0) {
+                    ESP_LOGE(TAG, "Glyph blitter mismatch at x=%d y=%d color=%d",
+                             offsets_x[ix], offsets_y[iy], color);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static void graphics_self_check(void)
+{
+    if ((s_graphics.phys_width % 8) != 0) {
+        ESP_LOGE(TAG, "Glyph blitter requires a display width that is a multiple of 8");
+        return;
+    }
+
+    const size_t size = s_graphics.bytes_per_row * s_graphics.phys_height;
+    uint8_t *expected = malloc(size * 2);
+    if (expected == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate self-check buffers");
+        return;
+    }
+    uint8_t *actual = expected + size;
+
+    bool ok = true;
+    for (size_t i = 0; ok && i <= 126 - 32; i++) {
+        ok = self_check_glyph(expected, actual, size, font_9x15[i]);
+    }
+    for (size_t i = 0; ok && i < font_ua_9x15_count; i++) {
+        if (get_glyph(font_ua_9x15[i].codepoint) != font_ua_9x15[i].glyph) {
+            ESP_LOGE(TAG, "Glyph index out of sync for U+%04X", font_ua_9x15[i].codepoint);
+            ok = false;
+            break;
+        }
+        ok = self_check_glyph(expected, actual, size, font_ua_9x15[i].glyph);
+    }
+
+    free(expected);
+    if (ok) {
+        ESP_LOGI(TAG, "Glyph blitter matches per-pixel renderer");
+    }
+}
+#endif
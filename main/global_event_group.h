@@ -17,12 +17,13 @@ extern int global_battery_level;
 /* Event bits */
 #define IS_WIFI_CONNECTED_BIT   BIT2
 #define IS_WIFI_FAILED_BIT      BIT3
-#define IS_OTA_UPDATE_RUNNING   BIT4
-#define IS_OTA_CHECK_DONE       BIT5
-#define IS_SNTP_SYNC_DONE       BIT6
 #define IS_SNTP_FIRST_SYNC_DONE BIT7
 #define IS_GPIO4_WAKEUP         BIT8
 #define IS_WIFI_AVAILABLE       BIT9
 #define IS_GPIO3_WAKEUP         BIT10
+#define IS_TRIGGER_EVENT        BIT12
+
+/* BIT13 and up: one "finished" bit per wake_job_t, owned by wake_scheduler */
+#define WAKE_JOB_DONE_SHIFT     13
 
 #endif /* GLOBAL_EVENT_GROUP_H */
@@ -0,0 +1,84 @@
+/**
+ * @file http_message.c
+ * @brief HTTP/1.0 request formatting and response parsing for https_get
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "http_message.h"
+
+bool http_message_split_url(const char *url, char *authority, const char **path)
+{
+  static const char scheme[] = "https://";
+  if (url == NULL || strncmp(url, scheme, sizeof(scheme) - 1) != 0)
+  {
+    return false;
+  }
+
+  const char *start = url + sizeof(scheme) - 1;
+  const char *slash = strchr(start, '/');
+  size_t len = slash != NULL ? (size_t)(slash - start) : strlen(start);
+  if (len == 0 || len >= HTTP_MESSAGE_AUTHORITY_LEN)
+  {
+    return false;
+  }
+
+  memcpy(authority, start, len);
+  authority[len] = '\0';
+  *path = slash != NULL ? slash : "/";
+  return true;
+}
+
+int http_message_format_request(char *buf, size_t size, const char *authority, const char *path,
+                                const https_get_header_t *headers, size_t header_count)
+{
+  int len = snprintf(buf, size, "GET %s HTTP/1.0\r\nHost: %s\r\n", path, authority);
+  for (size_t i = 0; i < header_count && len >= 0 && (size_t)len < size; i++)
+  {
+    len += snprintf(buf + len, size - len, "%s: %s\r\n", headers[i].name, headers[i].value);
+  }
+  if (len >= 0 && (size_t)len < size)
+  {
+    len += snprintf(buf + len, size - len, "Connection: close\r\n\r\n");
+  }
+
+  if (len < 0 || (size_t)len >= size)
+  {
+    return -1;
+  }
+  return len;
+}
+
+esp_err_t http_message_parse_response(char *buf, size_t len, https_get_response_t *response)
+{
+  char *headers_end = strstr(buf, "\r\n\r\n");
+  if (headers_end == NULL || sscanf(buf, "HTTP/%*d.%*d %d", &response->status) != 1)
+  {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+  *headers_end = '\0';
+
+  response->body = headers_end + 4;
+  response->body_len = len - (response->body - buf);
+  response->etag[0] = '\0';
+
+  for (char *line = strstr(buf, "\r\n"); line != NULL; line = strstr(line, "\r\n"))
+  {
+    line += 2;
+    if (strncasecmp(line, "ETag:", 5) == 0)
+    {
+      const char *value = line + 5;
+      value += strspn(value, " \t");
+      size_t value_len = strcspn(value, "\r\n");
+      if (value_len < HTTPS_GET_ETAG_LEN)
+      {
+        memcpy(response->etag, value, value_len);
+        response->etag[value_len] = '\0';
+      }
+    }
+  }
+
+  return ESP_OK;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file http_message.h
+ * @brief HTTP/1.0 request formatting and response parsing for https_get
+ *
+ * Kept apart from the TLS connection so it can be tested on the host.
+ */
+
+#ifndef HTTP_MESSAGE_H
+#define HTTP_MESSAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "https_get.h"
+
+/** Longest host[:port] accepted in a URL, including the terminator */
+#define HTTP_MESSAGE_AUTHORITY_LEN 72
+
+/**
+ * @brief Split an https:// URL into its authority and path
+ *
+ * @param url https://host[:port][/path]
+ * @param[out] authority host[:port], HTTP_MESSAGE_AUTHORITY_LEN bytes
+ * @param[out] path Path inside url, or "/" if the URL has none
+ * @return true on success, false if the URL is not https:// or the authority is empty or too long
+ */
+bool http_message_split_url(const char *url, char *authority, const char **path);
+
+/**
+ * @brief Format a GET request that closes the connection after the response
+ *
+ * @param buf Output buffer
+ * @param size Size of buf
+ * @param authority Value of the Host header
+ * @param path Request path
+ * @param headers Extra headers, or NULL
+ * @param header_count Number of entries in headers
+ * @return Length of the request without the terminator, or -1 if it does not fit
+ */
+int http_message_format_request(char *buf, size_t size, const char *authority, const char *path,
+                                const https_get_header_t *headers, size_t header_count);
+
+/**
+ * @brief Parse a complete response in place
+ *
+ * Fills in status, etag, body and body_len; the header block is terminated
+ * in buf, so the body stays NUL-terminated at buf[len].
+ *
+ * @param buf NUL-terminated response
+ * @param len Length of the response
+ * @param[out] response Parsed fields
+ * @return ESP_OK, or ESP_ERR_INVALID_RESPONSE if the response is not HTTP
+ */
+esp_err_t http_message_parse_response(char *buf, size_t len, https_get_response_t *response);
+
+#endif // HTTP_MESSAGE_H
@@ -0,0 +1,285 @@
+/**
+ * @file https_get.c
+ * @brief Minimal HTTPS GET with TLS session resumption across deep sleep
+ */
+
+#include <sdkconfig.h>
+#include <esp_log.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <esp_tls.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+
+#include "https_get.h"
+#include "http_message.h"
+#include "../power_mgmt/power_mgmt.h"
+
+#ifndef CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#error "https_get installs the server CA through the certificate bundle hook"
+#endif
+
+static const char *TAG = "https_get";
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+// A TLS 1.2 session with the peer certificate kept (MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+// and a ticket is about 1.2 KB for a 2048-bit RSA server certificate
+#define SESSION_MAX_LEN 1536
+
+typedef struct
+{
+  char authority[HTTP_MESSAGE_AUTHORITY_LEN];
+  uint16_t len;                   // 0 if nothing is cached
+  uint8_t data[SESSION_MAX_LEN];  // mbedtls_ssl_session_save() output
+} session_cache_t;
+
+// Zeroed on power-on, kept across deep sleep; a cold boot does a full handshake
+RTC_DATA_ATTR static session_cache_t s_session;
+#endif
+
+// CA chain of the connection in progress, and whether its certificate was checked
+static mbedtls_x509_crt s_ca;
+static bool s_verified;
+
+// Only called during a full handshake; a resumed session skips the Certificate message
+static int verify_callback(void *ctx, mbedtls_x509_crt *crt, int depth, uint32_t *flags)
+{
+  s_verified = true;
+  return 0;
+}
+
+// esp-tls hands its mbedtls_ssl_config out before the handshake only through
+// the certificate bundle hook, so the server CA is installed from there
+static esp_err_t attach_ca(void *conf)
+{
+  mbedtls_ssl_conf_ca_chain(conf, &s_ca, NULL);
+  mbedtls_ssl_conf_verify(conf, verify_callback, NULL);
+  return ESP_OK;
+}
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+// esp_tls_client_session_t only wraps the mbedtls_ssl_session it saved, which
+// is what esp_tls_free_client_session() frees, so it is (de)serialized as one
+static esp_tls_client_session_t *load_session(const char *authority)
+{
+  if (s_session.len == 0 || strcmp(s_session.authority, authority) != 0)
+  {
+    return NULL;
+  }
+
+  mbedtls_ssl_session *session = calloc(1, sizeof(*session));
+  if (session == NULL)
+  {
+    return NULL;
+  }
+  mbedtls_ssl_session_init(session);
+  if (mbedtls_ssl_session_load(session, s_session.data, s_session.len) != 0)
+  {
+    esp_tls_free_client_session((esp_tls_client_session_t *)session);
+    return NULL;
+  }
+  return (esp_tls_client_session_t *)session;
+}
+
+static void save_session(esp_tls_t *tls, const char *authority)
+{
+  esp_tls_client_session_t *session = esp_tls_get_client_session(tls);
+  if (session == NULL)
+  {
+    s_session.len = 0;
+    return;
+  }
+
+  size_t len = 0;
+  int ret = mbedtls_ssl_session_save((const mbedtls_ssl_session *)session, s_session.data,
+                                     sizeof(s_session.data), &len);
+  esp_tls_free_client_session(session);
+  if (ret != 0)
+  {
+    ESP_LOGW(TAG, "TLS session not cached (-0x%04x)", -ret);
+    s_session.len = 0;
+    return;
+  }
+
+  strlcpy(s_session.authority, authority, sizeof(s_session.authority));
+  s_session.len = (uint16_t)len;
+}
+
+static void forget_session(void)
+{
+  s_session.len = 0;
+}
+#else
+static esp_tls_client_session_t *load_session(const char *authority)
+{
+  return NULL;
+}
+
+static void save_session(esp_tls_t *tls, const char *authority)
+{
+}
+
+static void forget_session(void)
+{
+}
+#endif // CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+
+// Connect and handshake, offering the session if there is one
+static esp_err_t tls_connect(const https_get_request_t *request, esp_tls_client_session_t *session,
+                             esp_tls_t **tls_out)
+{
+  esp_tls_cfg_t cfg = {
+      .crt_bundle_attach = attach_ca,
+      .timeout_ms = request->timeout_ms,
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+      .client_session = session,
+#endif
+  };
+
+  esp_tls_t *tls = esp_tls_init();
+  if (tls == NULL)
+  {
+    return ESP_ERR_NO_MEM;
+  }
+
+  s_verified = false;
+  if (esp_tls_conn_http_new_sync(request->url, &cfg, tls) == 1)
+  {
+    *tls_out = tls;
+    return ESP_OK;
+  }
+
+  esp_err_t err = ESP_FAIL;
+  esp_tls_error_handle_t error_handle = NULL;
+  if (esp_tls_get_error_handle(tls, &error_handle) == ESP_OK && error_handle->last_error != ESP_OK)
+  {
+    err = error_handle->last_error;
+  }
+  esp_tls_conn_destroy(tls);
+  return err;
+}
+
+// Send the request in buf and read the whole response into it
+static esp_err_t tls_exchange(esp_tls_t *tls, char *buf, size_t size, int request_len, size_t *received)
+{
+  for (int written = 0; written < request_len;)
+  {
+    ssize_t ret = esp_tls_conn_write(tls, buf + written, request_len - written);
+    if (ret > 0)
+    {
+      written += ret;
+    }
+    else if (ret != ESP_TLS_ERR_SSL_WANT_READ && ret != ESP_TLS_ERR_SSL_WANT_WRITE)
+    {
+      ESP_LOGE(TAG, "Request write failed (-0x%04x)", (unsigned)-ret);
+      return ESP_FAIL;
+    }
+  }
+
+  // HTTP/1.0: the response ends when the server closes the connection
+  *received = 0;
+  while (true)
+  {
+    if (*received >= size - 1)
+    {
+      return ESP_ERR_INVALID_SIZE;
+    }
+    ssize_t ret = esp_tls_conn_read(tls, buf + *received, size - 1 - *received);
+    if (ret > 0)
+    {
+      *received += ret;
+    }
+    else if (ret == 0)
+    {
+      return ESP_OK;
+    }
+    else if (ret != ESP_TLS_ERR_SSL_WANT_READ && ret != ESP_TLS_ERR_SSL_WANT_WRITE)
+    {
+      ESP_LOGE(TAG, "Response read failed (-0x%04x)", (unsigned)-ret);
+      return ESP_FAIL;
+    }
+  }
+}
+
+esp_err_t https_get(const https_get_request_t *request, char *buf, size_t size, https_get_response_t *response)
+{
+  char authority[HTTP_MESSAGE_AUTHORITY_LEN];
+  const char *path;
+
+  memset(response, 0, sizeof(*response));
+  if (request == NULL || buf == NULL || size == 0 || !http_message_split_url(request->url, authority, &path))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // buf holds the request until it is sent, then the response
+  int request_len = http_message_format_request(buf, size, authority, path, request->headers,
+                                                request->header_count);
+  if (request_len < 0)
+  {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  mbedtls_x509_crt_init(&s_ca);
+  int ret = mbedtls_x509_crt_parse(&s_ca, (const unsigned char *)request->cert_pem, strlen(request->cert_pem) + 1);
+  if (ret != 0)
+  {
+    ESP_LOGE(TAG, "Invalid CA certificate (-0x%04x)", -ret);
+    mbedtls_x509_crt_free(&s_ca);
+    return ESP_FAIL;
+  }
+
+  // Only the handshake runs at full clock; the exchange is a few small records
+  power_mgmt_acquire(POWER_LOCK_TLS);
+
+  // The connection keeps its own copy of the offered session
+  esp_tls_client_session_t *session = load_session(authority);
+  bool offered = session != NULL;
+  esp_tls_t *tls = NULL;
+  int64_t start_us = esp_timer_get_time();
+  esp_err_t err = tls_connect(request, session, &tls);
+  if (session != NULL)
+  {
+    esp_tls_free_client_session(session);
+  }
+
+  // A server that fails the handshake over a stale session gets a clean retry
+  if (err == ESP_ERR_MBEDTLS_SSL_HANDSHAKE_FAILED && offered)
+  {
+    ESP_LOGW(TAG, "Handshake with cached session failed, retrying without it");
+    forget_session();
+    offered = false;
+    start_us = esp_timer_get_time();
+    err = tls_connect(request, NULL, &tls);
+  }
+  power_mgmt_release(POWER_LOCK_TLS);
+
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "TLS connection to %s failed (%s)", authority, esp_err_to_name(err));
+    mbedtls_x509_crt_free(&s_ca);
+    return err == ESP_ERR_NO_MEM ? err : ESP_FAIL;
+  }
+
+  response->handshake_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+  response->resumed = offered && !s_verified;
+  ESP_LOGI(TAG, "TLS handshake with %s: %lu ms (%s)", authority, (unsigned long)response->handshake_ms,
+           response->resumed ? "resumed" : offered ? "full, session rejected" : "full");
+
+  save_session(tls, authority);
+
+  size_t received = 0;
+  err = tls_exchange(tls, buf, size, request_len, &received);
+  esp_tls_conn_destroy(tls);
+  mbedtls_x509_crt_free(&s_ca);
+
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+
+  buf[received] = '\0';
+  return http_message_parse_response(buf, received, response);
+}
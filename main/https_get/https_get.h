@@ -0,0 +1,74 @@
+/**
+ * @file https_get.h
+ * @brief Minimal HTTPS GET with TLS session resumption across deep sleep
+ *
+ * Meant for small, frequent requests such as the OTA manifest check. The TLS
+ * session of the last connection is kept in RTC memory, so the next request
+ * to the same server after a deep-sleep wake-up can skip the full handshake.
+ * If the server does not accept the session, a full handshake is done.
+ */
+
+#ifndef HTTPS_GET_H
+#define HTTPS_GET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+/** Longest ETag kept from a response, including the terminator */
+#define HTTPS_GET_ETAG_LEN 64
+
+/**
+ * @brief Extra request header
+ */
+typedef struct {
+    const char *name;               /**< Header name, without the colon */
+    const char *value;              /**< Header value */
+} https_get_header_t;
+
+/**
+ * @brief What to fetch
+ */
+typedef struct {
+    const char *url;                /**< https://host[:port]/path */
+    const char *cert_pem;           /**< NUL-terminated PEM CA certificate of the server */
+    const https_get_header_t *headers;  /**< Extra headers, or NULL */
+    size_t header_count;            /**< Number of entries in headers */
+    uint32_t timeout_ms;            /**< Timeout of the TCP connect and of each read */
+} https_get_request_t;
+
+/**
+ * @brief Parsed response
+ */
+typedef struct {
+    int status;                     /**< HTTP status code */
+    char etag[HTTPS_GET_ETAG_LEN];  /**< ETag header, empty if none */
+    const char *body;               /**< NUL-terminated body inside the caller's buffer */
+    size_t body_len;                /**< Body length, without the terminator */
+    bool resumed;                   /**< TLS session was resumed */
+    uint32_t handshake_ms;          /**< Duration of the TCP connect and TLS handshake */
+} https_get_response_t;
+
+/**
+ * @brief Fetch a small resource over HTTPS
+ *
+ * Sends an HTTP/1.0 request so the body is never chunked, and reads until
+ * the server closes the connection. Offers the cached TLS session for the
+ * same server, and caches the new one afterwards. Not reentrant.
+ *
+ * @param request What to fetch
+ * @param buf Buffer for the whole response, headers included
+ * @param size Size of buf
+ * @param[out] response Parsed response; body points into buf
+ * @return
+ *     - ESP_OK on any HTTP status
+ *     - ESP_ERR_INVALID_ARG if the URL is not https://
+ *     - ESP_ERR_INVALID_SIZE if the request or the response does not fit in buf
+ *     - ESP_ERR_INVALID_RESPONSE if the response is not HTTP
+ *     - ESP_ERR_NO_MEM if the connection could not be allocated
+ *     - ESP_FAIL on connection or TLS errors
+ */
+esp_err_t https_get(const https_get_request_t *request, char *buf, size_t size, https_get_response_t *response);
+
+#endif // HTTPS_GET_H
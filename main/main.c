@@ -8,7 +8,6 @@
 #include <freertos/task.h>
 #include <esp_log.h>
 #include <esp_sleep.h>
-#include <nvs_flash.h>
 
 #include "global_constants.h"
 
@@ -22,11 +21,30 @@
 #include "sntp/sntp.h"
 #include "ota_update/ota_update.h"
 #include "deep_sleep/deep_sleep.h"
+#include "wake_profiler/wake_profiler.h"
+#include "wake_scheduler/wake_scheduler.h"
+#include "rtc_state/rtc_state.h"
+#include "power_mgmt/power_mgmt.h"
+#include "trigger/trigger.h"
 
 static const char *TAG = "toilet_timer";
 
 EventGroupHandle_t global_event_group;
 
+/* What a wake waits for before going back to sleep. Deadlines are in ms since
+ * the scheduler started; the OTA job extends its own once a download starts. */
+static const struct {
+    wake_job_t job;
+    uint32_t depends_on;
+    uint32_t deadline_ms;
+} wake_jobs[] = {
+    {WAKE_JOB_DISPLAY, 0, 60000},
+    {WAKE_JOB_BATTERY, 0, 5000},
+    {WAKE_JOB_WIFI, 0, 30000},
+    {WAKE_JOB_SNTP, WAKE_JOB_BIT(WAKE_JOB_WIFI), 45000},
+    {WAKE_JOB_OTA, WAKE_JOB_BIT(WAKE_JOB_WIFI), 60000},
+};
+
 void app_main(void)
 {
     ESP_LOGI(TAG, "Starting Toilet Timer");
@@ -36,6 +54,7 @@ void app_main(void)
 
     /* Check wake-up cause */
     esp_sleep_wakeup_cause_t wakeup_cause = esp_sleep_get_wakeup_cause();
+    wake_profiler_start(wakeup_cause);
     bool gpio4_wakeup = false;
     bool gpio3_wakeup = false;
     switch (wakeup_cause) {
@@ -43,6 +62,7 @@ void app_main(void)
             uint64_t wakeup_gpio_mask = esp_sleep_get_ext1_wakeup_status();
             ESP_LOGI(TAG, "Wake-up from deep sleep (EXT1 - GPIO button)");
             ESP_LOGI(TAG, "Wake-up GPIO mask: 0x%llx", wakeup_gpio_mask);
+            ESP_LOGI(TAG, "Spurious button wake-ups rejected by wake stub: %lu", deep_sleep_get_rejected_wakes());
             if (wakeup_gpio_mask & (1ULL << CONFIG_BUTTON_RIGHT_GPIO)) {
                 gpio4_wakeup = true;
                 ESP_LOGI(TAG, "GPIO%d triggered wake-up", CONFIG_BUTTON_RIGHT_GPIO);
@@ -65,18 +85,34 @@ void app_main(void)
             break;
     }
 
-    esp_err_t nvs_err = nvs_flash_init();
-    if (nvs_err == ESP_ERR_NVS_NO_FREE_PAGES || nvs_err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        nvs_flash_erase();
-        nvs_err = nvs_flash_init();
-    }
-    if (nvs_err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize NVS (%s)", esp_err_to_name(nvs_err));
+    /* NVS is only touched on cold boot; later writes initialize it on demand */
+    esp_err_t state_err = rtc_state_init(wakeup_cause);
+    if (state_err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize persistent state (%s)", esp_err_to_name(state_err));
         return;
     }
+    wake_profiler_mark(WAKE_PHASE_NVS_INIT);
+
+    /* Run at the XTAL clock and light-sleep while tasks wait; failing to configure it only costs power */
+    power_mgmt_init();
+
+#ifndef CONFIG_WIFI_DAILY_SYNC
+    /* Nothing but the day count changes on a timer wake-up; skip the task set */
+    if (wakeup_cause == ESP_SLEEP_WAKEUP_TIMER) {
+        show_messages_timer_wake();
+    }
+#endif
 
     global_event_group = xEventGroupCreate();
 
+    wake_scheduler_init();
+    for (size_t i = 0; i < sizeof(wake_jobs) / sizeof(wake_jobs[0]); i++) {
+        wake_scheduler_add(wake_jobs[i].job, wake_jobs[i].depends_on, wake_jobs[i].deadline_ms);
+    }
+
+    /* Capture presses from boot on, including while the first refresh runs */
+    trigger_init_interrupt(gpio4_wakeup);
+
     if (gpio4_wakeup) {
         xEventGroupSetBits(global_event_group, IS_GPIO4_WAKEUP);
     }
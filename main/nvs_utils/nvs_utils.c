@@ -5,16 +5,47 @@
 
 #include <esp_log.h>
 #include <nvs.h>
+#include <nvs_flash.h>
 #include "nvs_utils.h"
 
 static const char *TAG = "nvs_utils";
 
+static bool s_nvs_initialized = false;
+
+esp_err_t nvs_utils_init(void)
+{
+    if (s_nvs_initialized) {
+        return ESP_OK;
+    }
+
+    /* nvs_flash_init() is internally locked and returns ESP_OK if already done,
+     * so concurrent first calls from different tasks are harmless */
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "NVS partition needs to be erased (%s)", esp_err_to_name(err));
+        nvs_flash_erase();
+        err = nvs_flash_init();
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize NVS (%s)", esp_err_to_name(err));
+        return err;
+    }
+
+    s_nvs_initialized = true;
+    return ESP_OK;
+}
+
 esp_err_t nvs_utils_read_blob(const char *namespace, const char *key, void *data, size_t size)
 {
     nvs_handle_t handle;
     size_t required_size = size;
 
-    esp_err_t err = nvs_open(namespace, NVS_READONLY, &handle);
+    esp_err_t err = nvs_utils_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_open(namespace, NVS_READONLY, &handle);
     if (err != ESP_OK) {
         return err;
     }
@@ -29,7 +60,12 @@ esp_err_t nvs_utils_write_blob(const char *namespace, const char *key, const voi
 {
     nvs_handle_t handle;
 
-    esp_err_t err = nvs_open(namespace, NVS_READWRITE, &handle);
+    esp_err_t err = nvs_utils_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_open(namespace, NVS_READWRITE, &handle);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Failed to open NVS namespace '%s' for writing", namespace);
         return err;
@@ -12,6 +12,17 @@
 #include <stdbool.h>
 #include <time.h>
 
+/**
+ * @brief Initialize the NVS flash partition on first use
+ *
+ * Erases and re-initializes the partition if it is full or was written by a
+ * newer NVS version. Called by every read/write helper; call it directly
+ * before using the raw NVS API or a component that needs NVS (e.g. Wi-Fi).
+ *
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t nvs_utils_init(void);
+
 /**
  * @brief Read a blob from NVS
  * @param namespace NVS namespace
@@ -9,29 +9,53 @@
 #include <esp_http_client.h>
 #include <esp_app_desc.h>
 #include <esp_mac.h>
+#include <esp_timer.h>
 #include <string.h>
+#include <cJSON.h>
+#ifdef CONFIG_ESP32_DELTA_OTA_ENABLED
+#include <esp_delta_ota.h>
+#endif
+#if defined(CONFIG_ESP32_COMPRESSED_OTA_ENABLED) || defined(CONFIG_ESP32_OTA_BENCHMARK)
+#include <stdlib.h>
+#include <miniz.h>
+#endif
+#ifdef CONFIG_ESP32_OTA_PIPELINED
+#include <stdlib.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_app_format.h>
+#include <spi_flash_mmap.h>
+#endif
 
 #include "ota_update.h"
 #include "global_event_group.h"
+#include "../wake_profiler/wake_profiler.h"
+#include "../wake_scheduler/wake_scheduler.h"
+#include "../rtc_state/rtc_state.h"
+#include "../power_mgmt/power_mgmt.h"
+#include "../wifi/wifi.h"
+#include "../https_get/https_get.h"
 
 #define FIRMWARE_UPGRADE_URL CONFIG_ESP32_FIRMWARE_UPGRADE_URL
+#define FIRMWARE_MANIFEST_URL CONFIG_ESP32_FIRMWARE_MANIFEST_URL
+#define MANIFEST_MAX_LEN 2048
+#define MANIFEST_FILE_LEN 64
 #define HASH_LEN 32
+#define WAKE_PROFILE_HEADER_LEN 512
+#define DEVICE_HEADER_COUNT 2
 
 static const char *TAG = "OTA Update";
 
 static char *s_running_firmware_version = "Pending";
 
-static nvs_handle_t s_ota_nvs_handle;
-
-#define NVS_OTA_NAMESPACE "ota_info"
-#define NVS_OTA_HASH_KEY "firmware_hash"
-
 static uint8_t esp32_mac_address[6] = {0};
 static char esp32_mac_address_string[18];
 
 static uint8_t sha_256_current[HASH_LEN] = {0};
-static uint8_t sha_256_stored[HASH_LEN] = {0};
-static size_t stored_hash_size = HASH_LEN;
+
+// Firmware recorded in rtc_state: the running one, or the one an update installed
+static rtc_state_firmware_t stored_firmware;
+static bool stored_firmware_found;
 
 static const esp_partition_t *running_partition;
 static esp_app_desc_t running_app_info;
@@ -39,7 +63,44 @@ static esp_app_desc_t running_app_info;
 #ifdef CONFIG_IS_ESP32_FIRMWARE_UPGRADE_ENABLED
 extern const uint8_t server_cert_pem_start[] asm("_binary_cert_pem_start");
 extern const uint8_t server_cert_pem_end[] asm("_binary_cert_pem_end");
-static const uint8_t DELAY_BEFORE_UPDATE_CHECK_SECS = 10;
+// Time the download gets once it has started, on top of the check deadline
+static const uint32_t OTA_DOWNLOAD_DEADLINE_MS = 5 * 60 * 1000;
+
+// What local_ota_server/make_manifest.py publishes next to the image. sha256 is
+// the digest appended to the image, which esp_partition_get_sha256() returns
+// for an app partition, so it compares directly with the running firmware.
+typedef struct
+{
+  char version[32];
+  uint32_t size;
+  uint8_t sha256[HASH_LEN];
+  char patch_file[MANIFEST_FILE_LEN]; // Patch from the running firmware, empty if none
+  char compressed_file[MANIFEST_FILE_LEN]; // Deflate-compressed image, empty if none
+} ota_manifest_t;
+
+#ifdef CONFIG_ESP32_DELTA_OTA_ENABLED
+// Same header as esp_delta_ota's patch generator: magic, digest of the base
+// image (what esp_partition_get_sha256() returns for it), reserved
+#define DELTA_PATCH_MAGIC 0xfccdde10
+#define DELTA_PATCH_HEADER_LEN 64
+#define DELTA_CHUNK_LEN 1024
+
+static esp_ota_handle_t s_delta_ota_handle;
+#endif
+
+#if defined(CONFIG_ESP32_COMPRESSED_OTA_ENABLED) || defined(CONFIG_ESP32_OTA_BENCHMARK)
+// Raw deflate with a 2^12 byte window (make_manifest.py: wbits=-12), so the
+// output ring buffer stays small instead of tinfl's default 32 KB dictionary
+#define COMPRESSED_WINDOW_LEN 4096
+#define DOWNLOAD_CHUNK_LEN 1024
+
+typedef struct
+{
+  int wire_bytes;
+  int image_bytes;
+  int64_t duration_us;
+} ota_download_stats_t;
+#endif
 #endif
 
 static void print_sha256(const uint8_t *image_hash, const char *label)
@@ -53,20 +114,34 @@ static void print_sha256(const uint8_t *image_hash, const char *label)
   ESP_LOGI(TAG, "%s %s", label, hash_print);
 }
 
+static bool firmware_is_running(const rtc_state_firmware_t *firmware)
+{
+  return firmware->partition_address == running_partition->address &&
+         memcmp(firmware->app_elf_sha256, running_app_info.app_elf_sha256, HASH_LEN) == 0 &&
+         strncmp(firmware->version, running_app_info.version, sizeof(firmware->version)) == 0;
+}
+
+static void store_running_firmware(void)
+{
+  rtc_state_firmware_t firmware = {0};
+  memcpy(firmware.app_elf_sha256, running_app_info.app_elf_sha256, HASH_LEN);
+  strlcpy(firmware.version, running_app_info.version, sizeof(firmware.version));
+  firmware.partition_address = running_partition->address;
+  memcpy(firmware.partition_sha256, sha_256_current, HASH_LEN);
+
+  rtc_state_set_firmware_hash(&firmware);
+  stored_firmware = firmware;
+  stored_firmware_found = true;
+}
+
 static void check_current_firmware(void)
 {
   ESP_LOGI(TAG, "Checking current firmware...");
 
-  // Read the stored hash
-  nvs_open(NVS_OTA_NAMESPACE, NVS_READWRITE, &s_ota_nvs_handle);
-  esp_err_t err = nvs_get_blob(s_ota_nvs_handle, NVS_OTA_HASH_KEY, &sha_256_stored, &stored_hash_size);
-  if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+  if (stored_firmware_found)
   {
-    ESP_LOGE(TAG, "Failed to read hash from NVS: %s", esp_err_to_name(err));
-    return;
+    print_sha256(stored_firmware.partition_sha256, "Stored firmware hash:");
   }
-
-  print_sha256(sha_256_stored, "Stored firmware hash:");
   print_sha256(sha_256_current, "Current firmware hash:");
 
   // Check if the running partition is the factory partition
@@ -76,20 +151,25 @@ static void check_current_firmware(void)
   if (is_factory_partition)
   {
     ESP_LOGI(TAG, "Current partition is factory partition");
-    // If the stored hash is not the same as the factory one, save the current hash
-    if (stored_hash_size != HASH_LEN || memcmp(sha_256_current, sha_256_stored, HASH_LEN) != 0)
+    // If the stored firmware is not the factory one, record the current one
+    if (!stored_firmware_found || !firmware_is_running(&stored_firmware))
     {
-      nvs_set_blob(s_ota_nvs_handle, NVS_OTA_HASH_KEY, &sha_256_current, HASH_LEN);
-      nvs_commit(s_ota_nvs_handle);
+      store_running_firmware();
       ESP_LOGI(TAG, "Stored new firmware hash in NVS");
     }
     return;
   }
 
-  // If the stored hash is the same size and matches the current one
+  // If the stored hash matches the current one
   // We can mark it as valid and cancel the rollback
-  if (err == ESP_ERR_NVS_NOT_FOUND || (stored_hash_size == HASH_LEN && memcmp(sha_256_current, sha_256_stored, HASH_LEN) == 0))
+  if (!stored_firmware_found || memcmp(sha_256_current, stored_firmware.partition_sha256, HASH_LEN) == 0)
   {
+    // Keyed by this image from now on, so the next boot skips hashing
+    if (!stored_firmware_found || !firmware_is_running(&stored_firmware))
+    {
+      store_running_firmware();
+    }
+
     esp_ota_img_states_t ota_state;
     esp_ota_get_state_partition(running_partition, &ota_state);
 
@@ -113,23 +193,37 @@ static void check_current_firmware(void)
 static void get_running_firmware_info(void)
 {
   running_partition = esp_ota_get_running_partition();
-  esp_err_t err = esp_partition_get_sha256(running_partition, sha_256_current);
-  if (err != ESP_OK)
-  {
-    ESP_LOGE(TAG, "Failed to get partition SHA256");
-    vTaskDelete(NULL);
-  }
 
   if (esp_ota_get_partition_description(running_partition, &running_app_info) == ESP_OK)
   {
     s_running_firmware_version = running_app_info.version;
     ESP_LOGI(TAG, "Running firmware version: %s", s_running_firmware_version);
   }
+
+  // The partition is only hashed on the first boot after a USB flash; an OTA
+  // update records the hash of the image it installed before restarting
+  stored_firmware_found = rtc_state_get_firmware_hash(&stored_firmware);
+  if (stored_firmware_found && firmware_is_running(&stored_firmware))
+  {
+    memcpy(sha_256_current, stored_firmware.partition_sha256, HASH_LEN);
+    ESP_LOGI(TAG, "Firmware hash recorded for this image, partition not hashed");
+    return;
+  }
+
+  int64_t hash_start_us = esp_timer_get_time();
+  esp_err_t err = esp_partition_get_sha256(running_partition, sha_256_current);
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Failed to get partition SHA256");
+    vTaskDelete(NULL);
+  }
+  ESP_LOGI(TAG, "Hashed running partition in %lu ms",
+           (unsigned long)((esp_timer_get_time() - hash_start_us) / 1000));
 }
 
 #ifdef CONFIG_IS_ESP32_FIRMWARE_UPGRADE_ENABLED
 
-static esp_err_t validate_image_header(esp_app_desc_t *new_app_info)
+static esp_err_t validate_image_header(esp_app_desc_t *new_app_info, const ota_manifest_t *expected)
 {
   if (new_app_info == NULL)
   {
@@ -139,6 +233,17 @@ static esp_err_t validate_image_header(esp_app_desc_t *new_app_info)
   ESP_LOGI(TAG, "Running firmware version: %s", s_running_firmware_version);
   ESP_LOGI(TAG, "New firmware version: %s", new_app_info->version);
 
+  // The manifest already decided; just make sure it describes this image
+  if (expected != NULL)
+  {
+    if (strcmp(new_app_info->version, expected->version) != 0)
+    {
+      ESP_LOGE(TAG, "Image version does not match the manifest (%s)", expected->version);
+      return ESP_FAIL;
+    }
+    return ESP_OK;
+  }
+
   if (strcmp(new_app_info->version, s_running_firmware_version) == 0)
   {
     ESP_LOGW(TAG, "Current version matches new version. Skipping update.");
@@ -148,139 +253,1251 @@ static esp_err_t validate_image_header(esp_app_desc_t *new_app_info)
   return ESP_OK;
 }
 
+// Headers every request to the OTA server carries; returns how many were set
+static size_t get_device_headers(https_get_header_t *headers)
+{
+  size_t count = 0;
+  headers[count++] = (https_get_header_t){"ESP32-MAC", esp32_mac_address_string};
+
+  // Report recent wake timings so battery life can be tracked per device
+  static char wake_profile[WAKE_PROFILE_HEADER_LEN];
+  if (wake_profiler_format(wake_profile, sizeof(wake_profile)) > 0)
+  {
+    headers[count++] = (https_get_header_t){"ESP32-Wake-Profile", wake_profile};
+  }
+  return count;
+}
+
 static esp_err_t http_client_init_callback(esp_http_client_handle_t http_client)
 {
-  esp_http_client_set_header(http_client, "ESP32-MAC", esp32_mac_address_string);
+  https_get_header_t headers[DEVICE_HEADER_COUNT];
+  size_t count = get_device_headers(headers);
+  for (size_t i = 0; i < count; i++)
+  {
+    esp_http_client_set_header(http_client, headers[i].name, headers[i].value);
+  }
   return ESP_OK;
 }
 
-static void check_for_esp32_updates(void)
+static bool parse_sha256_hex(const char *hex, uint8_t *hash)
 {
-  ESP_LOGI(TAG, "Starting OTA update check...");
+  if (hex == NULL || strlen(hex) != HASH_LEN * 2)
+  {
+    return false;
+  }
+  for (int i = 0; i < HASH_LEN; i++)
+  {
+    unsigned int byte;
+    if (sscanf(&hex[i * 2], "%2x", &byte) != 1)
+    {
+      return false;
+    }
+    hash[i] = (uint8_t)byte;
+  }
+  return true;
+}
 
-  esp_http_client_config_t http_config = {
-      .url = FIRMWARE_UPGRADE_URL,
-      .cert_pem = (char *)server_cert_pem_start,
-      .keep_alive_enable = true,
+static esp_err_t parse_manifest(const char *json, ota_manifest_t *manifest)
+{
+  cJSON *root = cJSON_Parse(json);
+  if (root == NULL)
+  {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+
+  esp_err_t err = ESP_OK;
+  const cJSON *version = cJSON_GetObjectItemCaseSensitive(root, "version");
+  const cJSON *size = cJSON_GetObjectItemCaseSensitive(root, "size");
+  const cJSON *sha256 = cJSON_GetObjectItemCaseSensitive(root, "sha256");
+
+  if (!cJSON_IsString(version) || !cJSON_IsNumber(size) || size->valuedouble <= 0 ||
+      !cJSON_IsString(sha256) || !parse_sha256_hex(sha256->valuestring, manifest->sha256))
+  {
+    err = ESP_ERR_INVALID_RESPONSE;
+  }
+  else
+  {
+    strlcpy(manifest->version, version->valuestring, sizeof(manifest->version));
+    manifest->size = (uint32_t)size->valuedouble;
+  }
+
+  // "compressed": {"file": "<name>", "size": <bytes>}
+  manifest->compressed_file[0] = '\0';
+  const cJSON *compressed = cJSON_GetObjectItemCaseSensitive(root, "compressed");
+  const cJSON *compressed_file = cJSON_GetObjectItemCaseSensitive(compressed, "file");
+  if (cJSON_IsString(compressed_file) && strlen(compressed_file->valuestring) < sizeof(manifest->compressed_file))
+  {
+    strlcpy(manifest->compressed_file, compressed_file->valuestring, sizeof(manifest->compressed_file));
+  }
+
+  // "patches": [{"from": "<sha256 of a base image>", "file": "<name>"}, ...]
+  manifest->patch_file[0] = '\0';
+  const cJSON *patch = NULL;
+  cJSON_ArrayForEach(patch, cJSON_GetObjectItemCaseSensitive(root, "patches"))
+  {
+    uint8_t from[HASH_LEN];
+    const cJSON *from_hex = cJSON_GetObjectItemCaseSensitive(patch, "from");
+    const cJSON *file = cJSON_GetObjectItemCaseSensitive(patch, "file");
+    if (cJSON_IsString(from_hex) && parse_sha256_hex(from_hex->valuestring, from) &&
+        memcmp(from, sha_256_current, HASH_LEN) == 0 && cJSON_IsString(file) &&
+        strlen(file->valuestring) < sizeof(manifest->patch_file))
+    {
+      strlcpy(manifest->patch_file, file->valuestring, sizeof(manifest->patch_file));
+      break;
+    }
+  }
+
+  cJSON_Delete(root);
+  return err;
+}
+
+// Fetch the manifest and decide whether the image has to be downloaded.
+// Returns ESP_ERR_NOT_FOUND if the server has no manifest.
+static esp_err_t check_manifest(ota_manifest_t *manifest, bool *update_needed)
+{
+  *update_needed = false;
+
+  // An ETag is only reused while the firmware it was checked against is running
+  rtc_state_manifest_t cached = {0};
+  bool use_etag = rtc_state_get_manifest(&cached) && cached.etag[0] != '\0' &&
+                  memcmp(cached.firmware_hash, sha_256_current, HASH_LEN) == 0;
+
+  // The manifest goes through https_get so the TLS session survives deep sleep;
+  // the image itself is rare and large enough for esp_https_ota's full handshake
+  https_get_header_t headers[DEVICE_HEADER_COUNT + 1];
+  size_t header_count = get_device_headers(headers);
+  if (use_etag)
+  {
+    headers[header_count++] = (https_get_header_t){"If-None-Match", cached.etag};
+  }
+
+  https_get_request_t request = {
+      .url = FIRMWARE_MANIFEST_URL,
+      .cert_pem = (const char *)server_cert_pem_start,
+      .headers = headers,
+      .header_count = header_count,
       .timeout_ms = 10000,
   };
+  static char response_buf[MANIFEST_MAX_LEN + 1024];
+  https_get_response_t response;
 
-  esp_https_ota_config_t ota_config = {
-      .http_config = &http_config,
-      .http_client_init_cb = http_client_init_callback,
-  };
+  int64_t start_us = esp_timer_get_time();
+  esp_err_t err = https_get(&request, response_buf, sizeof(response_buf), &response);
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Failed to fetch manifest: %s", esp_err_to_name(err));
+    return err;
+  }
 
-  esp_https_ota_handle_t https_ota_handle = NULL;
-  esp_err_t err = esp_https_ota_begin(&ota_config, &https_ota_handle);
+  int status = response.status;
+  int body_len = (int)response.body_len;
+  ESP_LOGI(TAG, "Manifest: HTTP %d, %d bytes in %lld ms (TLS %s, %lu ms)", status, body_len,
+           (esp_timer_get_time() - start_us) / 1000, response.resumed ? "resumed" : "full",
+           (unsigned long)response.handshake_ms);
 
-  if (err != ESP_OK)
+  if (status == 304)
   {
-    ESP_LOGE(TAG, "OTA begin failed: %s", esp_err_to_name(err));
-    return;
+    ESP_LOGI(TAG, "Manifest not modified, firmware is up to date");
+    return ESP_OK;
+  }
+  if (status == 404)
+  {
+    return ESP_ERR_NOT_FOUND;
+  }
+  if (status != 200 || body_len <= 0 || body_len > MANIFEST_MAX_LEN)
+  {
+    return ESP_ERR_INVALID_RESPONSE;
   }
 
-  // Validate the new firmware version
-  esp_app_desc_t new_app_info;
-  err = esp_https_ota_get_img_desc(https_ota_handle, &new_app_info);
+  err = parse_manifest(response.body, manifest);
   if (err != ESP_OK)
   {
-    ESP_LOGE(TAG, "Failed to get image description: %s", esp_err_to_name(err));
-    esp_https_ota_abort(https_ota_handle);
-    return;
+    ESP_LOGE(TAG, "Invalid manifest: %s", response.body);
+    return err;
   }
 
-  err = validate_image_header(&new_app_info);
-  if (err != ESP_OK)
+  ESP_LOGI(TAG, "Manifest version: %s, size: %lu", manifest->version, (unsigned long)manifest->size);
+  if (manifest->patch_file[0] != '\0')
   {
-    ESP_LOGI(TAG, "Image validation failed, aborting OTA");
-    esp_https_ota_abort(https_ota_handle);
-    return;
+    ESP_LOGI(TAG, "Manifest lists a patch from the running firmware: %s", manifest->patch_file);
+  }
+  print_sha256(manifest->sha256, "Manifest firmware hash:");
+
+  if (memcmp(manifest->sha256, sha_256_current, HASH_LEN) == 0 ||
+      strcmp(manifest->version, s_running_firmware_version) == 0)
+  {
+    ESP_LOGI(TAG, "Running firmware matches the manifest, no update needed");
+
+    // Only a manifest that needed no download is worth a conditional request next time
+    rtc_state_manifest_t entry = {0};
+    strlcpy(entry.etag, response.etag, sizeof(entry.etag));
+    memcpy(entry.firmware_hash, sha_256_current, HASH_LEN);
+    rtc_state_set_manifest(&entry);
+    return ESP_OK;
   }
 
-  // Perform the OTA update
-  xEventGroupSetBits(global_event_group, IS_OTA_UPDATE_RUNNING);
+  const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+  if (update_partition == NULL || manifest->size > update_partition->size)
+  {
+    ESP_LOGE(TAG, "Image of %lu bytes does not fit the update partition", (unsigned long)manifest->size);
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  *update_needed = true;
+  return ESP_OK;
+}
+
+#if defined(CONFIG_ESP32_DELTA_OTA_ENABLED) || defined(CONFIG_ESP32_COMPRESSED_OTA_ENABLED)
+// Files listed in the manifest sit next to it
+static void manifest_file_url(char *url, size_t size, const char *file)
+{
+  const char *last_slash = strrchr(FIRMWARE_MANIFEST_URL, '/');
+  int dir_len = last_slash != NULL ? (int)(last_slash - FIRMWARE_MANIFEST_URL) + 1 : 0;
+  snprintf(url, size, "%.*s%s", dir_len, FIRMWARE_MANIFEST_URL, file);
+}
+#endif
+
+static void restart_into_new_firmware(void)
+{
+  ESP_LOGI(TAG, "OTA update successful!");
+
+  // Hashing the new image runs at full clock; the restart drops the lock
+  power_mgmt_acquire(POWER_LOCK_TLS);
+
+  // Record the new firmware, keyed by its app descriptor, so its first boot
+  // finds the hash instead of hashing the partition again
+  rtc_state_firmware_t firmware = {0};
+  esp_app_desc_t boot_app_info;
+  const esp_partition_t *boot_partition = esp_ota_get_boot_partition();
+  if (boot_partition != NULL &&
+      esp_ota_get_partition_description(boot_partition, &boot_app_info) == ESP_OK &&
+      esp_partition_get_sha256(boot_partition, firmware.partition_sha256) == ESP_OK)
+  {
+    memcpy(firmware.app_elf_sha256, boot_app_info.app_elf_sha256, HASH_LEN);
+    strlcpy(firmware.version, boot_app_info.version, sizeof(firmware.version));
+    firmware.partition_address = boot_partition->address;
+    print_sha256(firmware.partition_sha256, "New firmware hash:");
+
+    rtc_state_set_firmware_hash(&firmware);
+    ESP_LOGI(TAG, "Stored new firmware hash in NVS");
+  }
+
+  ESP_LOGI(TAG, "Restarting to new firmware...");
+  esp_restart();
+}
+
+#ifdef CONFIG_ESP32_DELTA_OTA_ENABLED
+
+// The base image is the running partition; offsets past the image read erased flash
+static esp_err_t delta_read_cb(uint8_t *buf, size_t size, int src_offset)
+{
+  return esp_partition_read(running_partition, src_offset, buf, size);
+}
+
+static esp_err_t delta_write_cb(const uint8_t *buf, size_t size)
+{
+  return esp_ota_write(s_delta_ota_handle, buf, size);
+}
+
+// Read exactly size bytes unless the stream ends first
+static int read_fully(esp_http_client_handle_t client, uint8_t *buf, int size)
+{
+  int total = 0;
+  while (total < size)
+  {
+    int len = esp_http_client_read(client, (char *)buf + total, size - total);
+    if (len <= 0)
+    {
+      break;
+    }
+    total += len;
+  }
+  return total;
+}
+
+static esp_err_t stream_patch(esp_http_client_handle_t client, esp_delta_ota_handle_t delta, int *patch_len)
+{
+  static uint8_t chunk[DELTA_CHUNK_LEN];
+
+  // The header is consumed here; detools only sees the patch behind it
+  if (read_fully(client, chunk, DELTA_PATCH_HEADER_LEN) != DELTA_PATCH_HEADER_LEN)
+  {
+    ESP_LOGE(TAG, "Patch shorter than its header");
+    return ESP_ERR_INVALID_SIZE;
+  }
+  uint32_t magic;
+  memcpy(&magic, chunk, sizeof(magic));
+  if (magic != DELTA_PATCH_MAGIC || memcmp(chunk + sizeof(magic), sha_256_current, HASH_LEN) != 0)
+  {
+    ESP_LOGE(TAG, "Patch was not built from the running firmware");
+    return ESP_ERR_INVALID_VERSION;
+  }
+  *patch_len = DELTA_PATCH_HEADER_LEN;
 
   while (1)
   {
-    err = esp_https_ota_perform(https_ota_handle);
-    if (err != ESP_ERR_HTTPS_OTA_IN_PROGRESS)
+    int len = esp_http_client_read(client, (char *)chunk, sizeof(chunk));
+    if (len < 0)
+    {
+      ESP_LOGE(TAG, "Patch download failed");
+      return ESP_FAIL;
+    }
+    if (len == 0)
     {
       break;
     }
-    ESP_LOGD(TAG, "Downloaded %d bytes", esp_https_ota_get_image_len_read(https_ota_handle));
+    esp_err_t err = esp_delta_ota_feed_patch(delta, chunk, len);
+    if (err != ESP_OK)
+    {
+      ESP_LOGE(TAG, "Applying patch failed: %s", esp_err_to_name(err));
+      return err;
+    }
+    *patch_len += len;
   }
 
-  if (!esp_https_ota_is_complete_data_received(https_ota_handle))
+  if (!esp_http_client_is_complete_data_received(client))
   {
-    ESP_LOGE(TAG, "Complete data was not received");
-    esp_https_ota_abort(https_ota_handle);
-    xEventGroupClearBits(global_event_group, IS_OTA_UPDATE_RUNNING);
-    return;
+    ESP_LOGE(TAG, "Complete patch was not received");
+    return ESP_FAIL;
   }
+  return esp_delta_ota_finalize(delta);
+}
 
-  err = esp_https_ota_finish(https_ota_handle);
-  if (err == ESP_OK)
+// Rebuild the new image from the running partition and the patch listed in
+// the manifest. Returns ESP_OK once the new image is set as boot partition.
+static esp_err_t apply_delta_update(const ota_manifest_t *expected)
+{
+  char url[sizeof(FIRMWARE_MANIFEST_URL) + MANIFEST_FILE_LEN];
+  manifest_file_url(url, sizeof(url), expected->patch_file);
+
+  const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+  if (update_partition == NULL)
+  {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  esp_http_client_config_t http_config = {
+      .url = url,
+      .cert_pem = (char *)server_cert_pem_start,
+      .timeout_ms = 10000,
+  };
+  esp_http_client_handle_t client = esp_http_client_init(&http_config);
+  if (client == NULL)
   {
-    ESP_LOGI(TAG, "OTA update successful!");
+    return ESP_FAIL;
+  }
+  http_client_init_callback(client);
+
+  int64_t start_us = esp_timer_get_time();
+  esp_err_t err = esp_http_client_open(client, 0);
+  if (err == ESP_OK && (esp_http_client_fetch_headers(client) < 0 || esp_http_client_get_status_code(client) != 200))
+  {
+    ESP_LOGE(TAG, "Patch request failed: HTTP %d", esp_http_client_get_status_code(client));
+    err = ESP_ERR_NOT_FOUND;
+  }
 
-    // Store the new firmware hash
-    uint8_t sha_256_boot[HASH_LEN] = {0};
-    const esp_partition_t *boot_partition = esp_ota_get_boot_partition();
-    if (boot_partition != NULL)
+  int patch_len = 0;
+  if (err == ESP_OK)
+  {
+    err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &s_delta_ota_handle);
+    if (err == ESP_OK)
     {
-      esp_partition_get_sha256(boot_partition, sha_256_boot);
-      print_sha256(sha_256_boot, "New firmware hash:");
+      esp_delta_ota_cfg_t delta_cfg = {
+          .read_cb = delta_read_cb,
+          .write_cb = delta_write_cb,
+      };
+      esp_delta_ota_handle_t delta = esp_delta_ota_init(&delta_cfg);
+      if (delta == NULL)
+      {
+        err = ESP_ERR_NO_MEM;
+      }
+      else
+      {
+        wifi_power_begin(WIFI_POWER_BULK);
+        err = stream_patch(client, delta, &patch_len);
+        wifi_power_end(WIFI_POWER_BULK);
+        esp_delta_ota_deinit(delta);
+      }
 
-      nvs_set_blob(s_ota_nvs_handle, NVS_OTA_HASH_KEY, &sha_256_boot, HASH_LEN);
-      nvs_commit(s_ota_nvs_handle);
-      ESP_LOGI(TAG, "Stored new firmware hash in NVS");
+      if (err == ESP_OK)
+      {
+        // Also validates the rebuilt image
+        err = esp_ota_end(s_delta_ota_handle);
+      }
+      else
+      {
+        esp_ota_abort(s_delta_ota_handle);
+      }
     }
+  }
+
+  esp_http_client_close(client);
+  esp_http_client_cleanup(client);
 
-    nvs_close(s_ota_nvs_handle);
-    ESP_LOGI(TAG, "Restarting to new firmware...");
-    esp_restart();
+  if (err != ESP_OK)
+  {
+    return err;
   }
-  else
+
+  uint8_t sha_256_new[HASH_LEN] = {0};
+  esp_partition_get_sha256(update_partition, sha_256_new);
+  if (memcmp(sha_256_new, expected->sha256, HASH_LEN) != 0)
   {
-    ESP_LOGE(TAG, "OTA finish failed: %s", esp_err_to_name(err));
-    xEventGroupClearBits(global_event_group, IS_OTA_UPDATE_RUNNING);
+    print_sha256(sha_256_new, "Patched firmware hash:");
+    ESP_LOGE(TAG, "Patched image does not match the manifest hash");
+    return ESP_ERR_INVALID_CRC;
   }
+
+  ESP_LOGI(TAG, "Applied %d byte patch instead of the %lu byte image in %lld ms", patch_len,
+           (unsigned long)expected->size, (esp_timer_get_time() - start_us) / 1000);
+  return esp_ota_set_boot_partition(update_partition);
 }
 
-#endif // CONFIG_IS_ESP32_FIRMWARE_UPGRADE_ENABLED
+#endif // CONFIG_ESP32_DELTA_OTA_ENABLED
 
-void ota_update_task(void *pvParameter)
+#if defined(CONFIG_ESP32_COMPRESSED_OTA_ENABLED) || defined(CONFIG_ESP32_OTA_BENCHMARK)
+
+// Inflate one received chunk through the window ring buffer into the OTA partition
+static esp_err_t inflate_chunk(tinfl_decompressor *inflator, uint8_t *window, size_t *window_pos,
+                               const uint8_t *in, size_t in_len, esp_ota_handle_t ota_handle,
+                               ota_download_stats_t *stats, bool *done)
 {
-  get_running_firmware_info();
-  check_current_firmware();
+  while (1)
+  {
+    size_t in_bytes = in_len;
+    size_t out_bytes = COMPRESSED_WINDOW_LEN - *window_pos;
+    tinfl_status status = tinfl_decompress(inflator, in, &in_bytes, window, window + *window_pos, &out_bytes,
+                                           TINFL_FLAG_HAS_MORE_INPUT);
+    in += in_bytes;
+    in_len -= in_bytes;
 
-#ifdef CONFIG_IS_ESP32_FIRMWARE_UPGRADE_ENABLED
-  ESP_LOGI(TAG, "OTA Updates enabled");
-  if (!(xEventGroupGetBits(global_event_group) & IS_WIFI_AVAILABLE)) {
-    ESP_LOGI(TAG, "Wi-Fi not available, skipping OTA check");
-    xEventGroupSetBits(global_event_group, IS_OTA_CHECK_DONE);
-    vTaskDelete(NULL);
-    return;
-  }
+    if (out_bytes > 0)
+    {
+      esp_err_t err = esp_ota_write(ota_handle, window + *window_pos, out_bytes);
+      if (err != ESP_OK)
+      {
+        return err;
+      }
+      stats->image_bytes += out_bytes;
+      *window_pos = (*window_pos + out_bytes) & (COMPRESSED_WINDOW_LEN - 1);
+    }
 
-  ESP_LOGI(TAG, "Waiting for Wi-Fi connection...");
-  xEventGroupWaitBits(global_event_group, IS_WIFI_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+    if (status < TINFL_STATUS_DONE)
+    {
+      ESP_LOGE(TAG, "Inflate failed: %d", status);
+      return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (status == TINFL_STATUS_DONE)
+    {
+      *done = true;
+      return ESP_OK;
+    }
+    if (status == TINFL_STATUS_NEEDS_MORE_INPUT && in_len == 0)
+    {
+      return ESP_OK;
+    }
+  }
+}
 
-  vTaskDelay(1000 * DELAY_BEFORE_UPDATE_CHECK_SECS / portTICK_PERIOD_MS);
+// Stream an image into an OTA partition that esp_ota_begin() has opened,
+// inflating it on the way if it is compressed
+static esp_err_t download_image(const char *url, bool compressed, esp_ota_handle_t ota_handle,
+                                ota_download_stats_t *stats)
+{
+  memset(stats, 0, sizeof(*stats));
 
-  esp_read_mac(esp32_mac_address, ESP_MAC_EFUSE_FACTORY);
-  snprintf(esp32_mac_address_string, sizeof(esp32_mac_address_string), "%02X:%02X:%02X:%02X:%02X:%02X",
-           esp32_mac_address[0], esp32_mac_address[1], esp32_mac_address[2],
-           esp32_mac_address[3], esp32_mac_address[4], esp32_mac_address[5]);
+  tinfl_decompressor *inflator = NULL;
+  uint8_t *window = NULL;
+  size_t window_pos = 0;
+  bool done = !compressed;
+  if (compressed)
+  {
+    // The decompressor's Huffman tables are too big for the task stack
+    inflator = malloc(sizeof(*inflator));
+    window = malloc(COMPRESSED_WINDOW_LEN);
+    if (inflator == NULL || window == NULL)
+    {
+      free(inflator);
+      free(window);
+      return ESP_ERR_NO_MEM;
+    }
+    tinfl_init(inflator);
+  }
 
+  esp_http_client_config_t http_config = {
+      .url = url,
+      .cert_pem = (char *)server_cert_pem_start,
+      .timeout_ms = 10000,
+  };
+  esp_http_client_handle_t client = esp_http_client_init(&http_config);
+  esp_err_t err = client != NULL ? ESP_OK : ESP_FAIL;
+  if (err == ESP_OK)
+  {
+    http_client_init_callback(client);
+    err = esp_http_client_open(client, 0);
+  }
+  if (err == ESP_OK && (esp_http_client_fetch_headers(client) < 0 || esp_http_client_get_status_code(client) != 200))
+  {
+    ESP_LOGE(TAG, "Request for %s failed: HTTP %d", url, esp_http_client_get_status_code(client));
+    err = ESP_ERR_NOT_FOUND;
+  }
+
+  static uint8_t chunk[DOWNLOAD_CHUNK_LEN];
+  int64_t start_us = esp_timer_get_time();
+  wifi_power_begin(WIFI_POWER_BULK);
+  while (err == ESP_OK)
+  {
+    int len = esp_http_client_read(client, (char *)chunk, sizeof(chunk));
+    if (len < 0)
+    {
+      err = ESP_FAIL;
+      break;
+    }
+    if (len == 0)
+    {
+      break;
+    }
+    stats->wire_bytes += len;
+
+    if (!compressed)
+    {
+      err = esp_ota_write(ota_handle, chunk, len);
+      stats->image_bytes += len;
+    }
+    else if (!done)
+    {
+      err = inflate_chunk(inflator, window, &window_pos, chunk, len, ota_handle, stats, &done);
+    }
+  }
+  wifi_power_end(WIFI_POWER_BULK);
+  stats->duration_us = esp_timer_get_time() - start_us;
+
+  if (err == ESP_OK && (!done || !esp_http_client_is_complete_data_received(client)))
+  {
+    ESP_LOGE(TAG, "Complete image was not received");
+    err = ESP_FAIL;
+  }
+
+  if (client != NULL)
+  {
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+  }
+  free(inflator);
+  free(window);
+  return err;
+}
+
+static void log_download_stats(const char *label, const ota_download_stats_t *stats)
+{
+  int64_t ms = stats->duration_us / 1000;
+  ESP_LOGI(TAG, "%s: %d bytes on the wire, %d bytes of image in %lld ms (%lld KB/s on the wire, %lld KB/s of image)",
+           label, stats->wire_bytes, stats->image_bytes, ms,
+           ms > 0 ? stats->wire_bytes / ms : 0, ms > 0 ? stats->image_bytes / ms : 0);
+}
+
+#endif // CONFIG_ESP32_COMPRESSED_OTA_ENABLED || CONFIG_ESP32_OTA_BENCHMARK
+
+#ifdef CONFIG_ESP32_COMPRESSED_OTA_ENABLED
+
+// Download the compressed image listed in the manifest and inflate it into
+// the update partition. Returns ESP_OK once it is set as boot partition.
+static esp_err_t apply_compressed_update(const ota_manifest_t *expected)
+{
+  char url[sizeof(FIRMWARE_MANIFEST_URL) + MANIFEST_FILE_LEN];
+  manifest_file_url(url, sizeof(url), expected->compressed_file);
+
+  const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+  if (update_partition == NULL)
+  {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  esp_ota_handle_t ota_handle;
+  esp_err_t err = esp_ota_begin(update_partition, expected->size, &ota_handle);
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+
+  ota_download_stats_t stats;
+  err = download_image(url, true, ota_handle, &stats);
+  if (err != ESP_OK)
+  {
+    esp_ota_abort(ota_handle);
+    return err;
+  }
+
+  // Also validates the inflated image
+  err = esp_ota_end(ota_handle);
+  if (err != ESP_OK)
+  {
+    return err;
+  }
+
+  uint8_t sha_256_new[HASH_LEN] = {0};
+  esp_partition_get_sha256(update_partition, sha_256_new);
+  if (memcmp(sha_256_new, expected->sha256, HASH_LEN) != 0)
+  {
+    print_sha256(sha_256_new, "Inflated firmware hash:");
+    ESP_LOGE(TAG, "Inflated image does not match the manifest hash");
+    return ESP_ERR_INVALID_CRC;
+  }
+
+  log_download_stats("Compressed image", &stats);
+  return esp_ota_set_boot_partition(update_partition);
+}
+
+#endif // CONFIG_ESP32_COMPRESSED_OTA_ENABLED
+
+#ifdef CONFIG_ESP32_OTA_BENCHMARK
+
+// Download the raw and the compressed image into the update partition without
+// installing either, and compare throughput
+static void run_download_benchmark(void)
+{
+  const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+  if (update_partition == NULL)
+  {
+    return;
+  }
+
+  static const struct
+  {
+    const char *label;
+    const char *url;
+    bool compressed;
+  } runs[] = {
+      {"Raw image", FIRMWARE_UPGRADE_URL, false},
+      {"Compressed image", FIRMWARE_UPGRADE_URL ".deflate", true},
+  };
+
+  ESP_LOGW(TAG, "OTA benchmark enabled: downloading without installing");
+  for (int i = 0; i < sizeof(runs) / sizeof(runs[0]); i++)
+  {
+    esp_ota_handle_t ota_handle;
+    ota_download_stats_t stats;
+
+    // Erase the whole partition up front so both runs measure download and write only
+    esp_err_t err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &ota_handle);
+    if (err == ESP_OK)
+    {
+      err = download_image(runs[i].url, runs[i].compressed, ota_handle, &stats);
+      esp_ota_abort(ota_handle);
+    }
+
+    if (err == ESP_OK)
+    {
+      log_download_stats(runs[i].label, &stats);
+    }
+    else
+    {
+      ESP_LOGE(TAG, "%s: %s", runs[i].label, esp_err_to_name(err));
+    }
+  }
+}
+
+#endif // CONFIG_ESP32_OTA_BENCHMARK
+
+#ifdef CONFIG_ESP32_OTA_PIPELINED
+
+// One task receives into a buffer while another writes the other one to flash.
+// The writer erases sectors ahead of its write pointer whenever it has no
+// data yet, so erases mostly overlap with network reads instead of stalling them.
+#define PIPELINE_BUFFER_LEN (16 * 1024)
+#define PIPELINE_BUFFER_COUNT 2
+#define PIPELINE_ERASE_AHEAD_LEN (64 * 1024)
+
+typedef struct
+{
+  uint8_t *data;
+  int len; // 0 ends the stream
+} pipeline_buffer_t;
+
+typedef struct
+{
+  const esp_partition_t *partition;
+  esp_ota_handle_t ota_handle;
+  QueueHandle_t filled;
+  QueueHandle_t free;
+  SemaphoreHandle_t writer_done;
+  uint32_t erase_limit; // Image size rounded up to sectors, or the partition size
+  uint32_t erased_end;
+  uint32_t written;
+  esp_err_t write_err;
+  int64_t write_us;
+  int64_t erase_us;
+  int64_t erase_stall_us; // Erases a pending buffer had to wait for
+  int64_t writer_wait_us; // Writer waiting for the network
+} pipeline_t;
+
+static void pipeline_erase_next_sector(pipeline_t *pipeline)
+{
+  if (pipeline->erased_end >= pipeline->partition->size)
+  {
+    ESP_LOGE(TAG, "Image does not fit the update partition");
+    pipeline->write_err = ESP_ERR_INVALID_SIZE;
+    return;
+  }
+
+  int64_t start_us = esp_timer_get_time();
+  pipeline->write_err = esp_partition_erase_range(pipeline->partition, pipeline->erased_end, SPI_FLASH_SEC_SIZE);
+  pipeline->erase_us += esp_timer_get_time() - start_us;
+  pipeline->erased_end += SPI_FLASH_SEC_SIZE;
+}
+
+static void pipeline_writer_task(void *pvParameter)
+{
+  pipeline_t *pipeline = pvParameter;
+  pipeline_buffer_t buffer;
+
+  while (1)
+  {
+    bool erase_ahead = pipeline->write_err == ESP_OK && pipeline->erased_end < pipeline->erase_limit &&
+                       pipeline->erased_end < pipeline->written + PIPELINE_ERASE_AHEAD_LEN;
+
+    int64_t wait_start_us = esp_timer_get_time();
+    if (xQueueReceive(pipeline->filled, &buffer, erase_ahead ? 0 : portMAX_DELAY) != pdTRUE)
+    {
+      pipeline_erase_next_sector(pipeline);
+      continue;
+    }
+    pipeline->writer_wait_us += esp_timer_get_time() - wait_start_us;
+
+    if (buffer.len == 0)
+    {
+      break;
+    }
+
+    // Keep draining after an error so the receiver never blocks on a free buffer
+    if (pipeline->write_err == ESP_OK)
+    {
+      int64_t stall_start_us = esp_timer_get_time();
+      while (pipeline->write_err == ESP_OK && pipeline->erased_end < pipeline->written + buffer.len)
+      {
+        pipeline_erase_next_sector(pipeline);
+      }
+      pipeline->erase_stall_us += esp_timer_get_time() - stall_start_us;
+    }
+    if (pipeline->write_err == ESP_OK)
+    {
+      int64_t write_start_us = esp_timer_get_time();
+      pipeline->write_err = esp_ota_write(pipeline->ota_handle, buffer.data, buffer.len);
+      pipeline->write_us += esp_timer_get_time() - write_start_us;
+      pipeline->written += buffer.len;
+    }
+
+    xQueueSend(pipeline->free, &buffer, portMAX_DELAY);
+  }
+
+  xSemaphoreGive(pipeline->writer_done);
+  vTaskDelete(NULL);
+}
+
+// Fill a buffer from the download stream
+static esp_err_t pipeline_fill(esp_http_client_handle_t client, pipeline_buffer_t *buffer, bool *end_of_stream,
+                               int64_t *receive_us)
+{
+  int64_t read_start_us = esp_timer_get_time();
+  esp_err_t err = ESP_OK;
+
+  buffer->len = 0;
+  while (buffer->len < PIPELINE_BUFFER_LEN)
+  {
+    int len = esp_http_client_read(client, (char *)buffer->data + buffer->len, PIPELINE_BUFFER_LEN - buffer->len);
+    if (len < 0)
+    {
+      ESP_LOGE(TAG, "Image download failed");
+      err = ESP_FAIL;
+      break;
+    }
+    if (len == 0)
+    {
+      *end_of_stream = true;
+      break;
+    }
+    buffer->len += len;
+  }
+
+  *receive_us += esp_timer_get_time() - read_start_us;
+  return err;
+}
+
+// Check the app descriptor at the start of the image
+static esp_err_t pipeline_validate_first(const pipeline_buffer_t *buffer, const ota_manifest_t *expected)
+{
+  const size_t desc_offset = sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t);
+  esp_app_desc_t new_app_info;
+  if (buffer->len < desc_offset + sizeof(new_app_info))
+  {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(&new_app_info, buffer->data + desc_offset, sizeof(new_app_info));
+  return validate_image_header(&new_app_info, expected);
+}
+
+// Receive the rest of the image into free buffers and hand them to the writer
+static esp_err_t pipeline_receive(pipeline_t *pipeline, esp_http_client_handle_t client, bool end_of_stream,
+                                  int64_t *receive_us, int64_t *receiver_wait_us)
+{
+  esp_err_t err = ESP_OK;
+
+  while (err == ESP_OK && !end_of_stream)
+  {
+    pipeline_buffer_t buffer;
+    int64_t wait_start_us = esp_timer_get_time();
+    xQueueReceive(pipeline->free, &buffer, portMAX_DELAY);
+    *receiver_wait_us += esp_timer_get_time() - wait_start_us;
+
+    if (pipeline->write_err != ESP_OK)
+    {
+      return pipeline->write_err;
+    }
+
+    err = pipeline_fill(client, &buffer, &end_of_stream, receive_us);
+    if (err == ESP_OK && buffer.len > 0)
+    {
+      xQueueSend(pipeline->filled, &buffer, portMAX_DELAY);
+    }
+    else
+    {
+      xQueueSend(pipeline->free, &buffer, portMAX_DELAY);
+    }
+  }
+
+  if (err == ESP_OK && !esp_http_client_is_complete_data_received(client))
+  {
+    ESP_LOGE(TAG, "Complete data was not received");
+    err = ESP_FAIL;
+  }
+  return err;
+}
+
+// Download the raw image through the receive/write pipeline. Returns ESP_OK
+// once it is set as boot partition.
+static esp_err_t pipelined_update(const ota_manifest_t *expected)
+{
+  pipeline_t pipeline = {
+      .partition = esp_ota_get_next_update_partition(NULL),
+  };
+  if (pipeline.partition == NULL)
+  {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  esp_http_client_config_t http_config = {
+      .url = FIRMWARE_UPGRADE_URL,
+      .cert_pem = (char *)server_cert_pem_start,
+      .timeout_ms = 10000,
+      .buffer_size = 4096,
+  };
+  esp_http_client_handle_t client = esp_http_client_init(&http_config);
+  if (client == NULL)
+  {
+    return ESP_FAIL;
+  }
+  http_client_init_callback(client);
+
+  int64_t start_us = esp_timer_get_time();
+  esp_err_t err = esp_http_client_open(client, 0);
+  int64_t image_size = err == ESP_OK ? esp_http_client_fetch_headers(client) : -1;
+  if (err == ESP_OK && esp_http_client_get_status_code(client) != 200)
+  {
+    ESP_LOGE(TAG, "Image request failed: HTTP %d", esp_http_client_get_status_code(client));
+    err = ESP_ERR_NOT_FOUND;
+  }
+  if (err == ESP_OK && expected != NULL && image_size != expected->size)
+  {
+    ESP_LOGE(TAG, "Image size %lld does not match the manifest (%lu)", image_size, (unsigned long)expected->size);
+    err = ESP_ERR_INVALID_SIZE;
+  }
+  if (err == ESP_OK && image_size > (int64_t)pipeline.partition->size)
+  {
+    ESP_LOGE(TAG, "Image of %lld bytes does not fit the update partition", image_size);
+    err = ESP_ERR_INVALID_SIZE;
+  }
+  if (err == ESP_OK && !wake_scheduler_extend(WAKE_JOB_OTA, OTA_DOWNLOAD_DEADLINE_MS))
+  {
+    ESP_LOGW(TAG, "OTA deadline already passed, not starting the download");
+    err = ESP_ERR_TIMEOUT;
+  }
+
+  uint8_t *buffers = NULL;
+  if (err == ESP_OK)
+  {
+    buffers = malloc(PIPELINE_BUFFER_LEN * PIPELINE_BUFFER_COUNT);
+    err = buffers != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+  }
+
+  // Read and check the first buffer before esp_ota_begin() erases anything, so
+  // a rejected image leaves the update partition untouched
+  int64_t receive_us = 0;
+  int64_t receiver_wait_us = 0;
+  bool end_of_stream = false;
+  pipeline_buffer_t first = {.data = buffers};
+  if (err == ESP_OK)
+  {
+    // Keep the modem awake for the download; power save would throttle it to the beacon interval
+    wifi_power_begin(WIFI_POWER_BULK);
+    err = pipeline_fill(client, &first, &end_of_stream, &receive_us);
+    if (err == ESP_OK)
+    {
+      err = pipeline_validate_first(&first, expected);
+    }
+
+    // Only the first sector is erased up front; the writer erases the rest as it goes
+    if (err == ESP_OK)
+    {
+      err = esp_ota_begin(pipeline.partition, SPI_FLASH_SEC_SIZE, &pipeline.ota_handle);
+    }
+    if (err != ESP_OK)
+    {
+      wifi_power_end(WIFI_POWER_BULK);
+    }
+  }
+  if (err != ESP_OK)
+  {
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    free(buffers);
+    return err;
+  }
+  pipeline.erased_end = SPI_FLASH_SEC_SIZE;
+  pipeline.erase_limit = image_size > 0 ? (image_size + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1)
+                                        : pipeline.partition->size;
+
+  pipeline.filled = xQueueCreate(PIPELINE_BUFFER_COUNT + 1, sizeof(pipeline_buffer_t));
+  pipeline.free = xQueueCreate(PIPELINE_BUFFER_COUNT, sizeof(pipeline_buffer_t));
+  pipeline.writer_done = xSemaphoreCreateBinary();
+
+  if (pipeline.filled == NULL || pipeline.free == NULL || pipeline.writer_done == NULL ||
+      xTaskCreate(pipeline_writer_task, "ota_writer", 4096, &pipeline, uxTaskPriorityGet(NULL), NULL) != pdPASS)
+  {
+    err = ESP_ERR_NO_MEM;
+  }
+  else
+  {
+    xQueueSend(pipeline.filled, &first, 0);
+    for (int i = 1; i < PIPELINE_BUFFER_COUNT; i++)
+    {
+      pipeline_buffer_t buffer = {.data = buffers + i * PIPELINE_BUFFER_LEN};
+      xQueueSend(pipeline.free, &buffer, 0);
+    }
+
+    err = pipeline_receive(&pipeline, client, end_of_stream, &receive_us, &receiver_wait_us);
+
+    pipeline_buffer_t end = {0};
+    xQueueSend(pipeline.filled, &end, portMAX_DELAY);
+    xSemaphoreTake(pipeline.writer_done, portMAX_DELAY);
+    if (err == ESP_OK)
+    {
+      err = pipeline.write_err;
+    }
+  }
+  wifi_power_end(WIFI_POWER_BULK);
+
+  esp_http_client_close(client);
+  esp_http_client_cleanup(client);
+  free(buffers);
+  if (pipeline.filled != NULL)
+  {
+    vQueueDelete(pipeline.filled);
+  }
+  if (pipeline.free != NULL)
+  {
+    vQueueDelete(pipeline.free);
+  }
+  if (pipeline.writer_done != NULL)
+  {
+    vSemaphoreDelete(pipeline.writer_done);
+  }
+
+  int64_t total_ms = (esp_timer_get_time() - start_us) / 1000;
+  ESP_LOGI(TAG, "Pipelined OTA: %lu bytes in %lld ms (%lld KB/s)", (unsigned long)pipeline.written, total_ms,
+           total_ms > 0 ? pipeline.written / total_ms : 0);
+  ESP_LOGI(TAG, "  network %lld ms, receiver waited %lld ms for a free buffer",
+           receive_us / 1000, receiver_wait_us / 1000);
+  ESP_LOGI(TAG, "  flash write %lld ms, erase %lld ms (%lld ms of it stalling a write), writer waited %lld ms for data",
+           pipeline.write_us / 1000, pipeline.erase_us / 1000, pipeline.erase_stall_us / 1000,
+           pipeline.writer_wait_us / 1000);
+
+  if (err != ESP_OK)
+  {
+    esp_ota_abort(pipeline.ota_handle);
+    return err;
+  }
+
+  // Also validates the image
+  err = esp_ota_end(pipeline.ota_handle);
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "OTA end failed: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  // Don't boot an image that differs from what the manifest announced
+  if (expected != NULL)
+  {
+    uint8_t sha_256_new[HASH_LEN] = {0};
+    esp_partition_get_sha256(pipeline.partition, sha_256_new);
+    if (memcmp(sha_256_new, expected->sha256, HASH_LEN) != 0)
+    {
+      print_sha256(sha_256_new, "Downloaded firmware hash:");
+      ESP_LOGE(TAG, "Downloaded image does not match the manifest hash");
+      return ESP_ERR_INVALID_CRC;
+    }
+  }
+
+  return esp_ota_set_boot_partition(pipeline.partition);
+}
+
+#else
+
+// Download the raw image with esp_https_ota. Returns ESP_OK once it is set
+// as boot partition.
+static esp_err_t https_ota_update(const ota_manifest_t *expected)
+{
+  esp_http_client_config_t http_config = {
+      .url = FIRMWARE_UPGRADE_URL,
+      .cert_pem = (char *)server_cert_pem_start,
+      .keep_alive_enable = true,
+      .timeout_ms = 10000,
+  };
+
+  esp_https_ota_config_t ota_config = {
+      .http_config = &http_config,
+      .http_client_init_cb = http_client_init_callback,
+  };
+
+  esp_https_ota_handle_t https_ota_handle = NULL;
+  esp_err_t err = esp_https_ota_begin(&ota_config, &https_ota_handle);
+
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "OTA begin failed: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  // Validate the new firmware version
+  esp_app_desc_t new_app_info;
+  err = esp_https_ota_get_img_desc(https_ota_handle, &new_app_info);
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Failed to get image description: %s", esp_err_to_name(err));
+    esp_https_ota_abort(https_ota_handle);
+    return err;
+  }
+
+  err = validate_image_header(&new_app_info, expected);
+  if (err != ESP_OK)
+  {
+    ESP_LOGI(TAG, "Image validation failed, aborting OTA");
+    esp_https_ota_abort(https_ota_handle);
+    return err;
+  }
+
+  if (expected != NULL && esp_https_ota_get_image_size(https_ota_handle) != (int)expected->size)
+  {
+    ESP_LOGE(TAG, "Image size %d does not match the manifest (%lu)",
+             esp_https_ota_get_image_size(https_ota_handle), (unsigned long)expected->size);
+    esp_https_ota_abort(https_ota_handle);
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  // Perform the OTA update; keep the device awake until the download is done
+  if (!wake_scheduler_extend(WAKE_JOB_OTA, OTA_DOWNLOAD_DEADLINE_MS))
+  {
+    ESP_LOGW(TAG, "OTA deadline already passed, not starting the download");
+    esp_https_ota_abort(https_ota_handle);
+    return ESP_ERR_TIMEOUT;
+  }
+
+  // Keep the modem awake for the download; power save would throttle it to the beacon interval
+  wifi_power_begin(WIFI_POWER_BULK);
+  while (1)
+  {
+    err = esp_https_ota_perform(https_ota_handle);
+    if (err != ESP_ERR_HTTPS_OTA_IN_PROGRESS)
+    {
+      break;
+    }
+    ESP_LOGD(TAG, "Downloaded %d bytes", esp_https_ota_get_image_len_read(https_ota_handle));
+  }
+  wifi_power_end(WIFI_POWER_BULK);
+
+  if (!esp_https_ota_is_complete_data_received(https_ota_handle))
+  {
+    ESP_LOGE(TAG, "Complete data was not received");
+    esp_https_ota_abort(https_ota_handle);
+    return ESP_FAIL;
+  }
+
+  // Don't boot an image that differs from what the manifest announced
+  if (expected != NULL)
+  {
+    uint8_t sha_256_new[HASH_LEN] = {0};
+    const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+    if (update_partition == NULL ||
+        esp_partition_get_sha256(update_partition, sha_256_new) != ESP_OK ||
+        memcmp(sha_256_new, expected->sha256, HASH_LEN) != 0)
+    {
+      print_sha256(sha_256_new, "Downloaded firmware hash:");
+      ESP_LOGE(TAG, "Downloaded image does not match the manifest hash");
+      esp_https_ota_abort(https_ota_handle);
+      return ESP_ERR_INVALID_CRC;
+    }
+  }
+
+  err = esp_https_ota_finish(https_ota_handle);
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "OTA finish failed: %s", esp_err_to_name(err));
+  }
+  return err;
+}
+
+#endif // CONFIG_ESP32_OTA_PIPELINED
+
+static void check_for_esp32_updates(void)
+{
+  ESP_LOGI(TAG, "Starting OTA update check...");
+
+  // With a manifest, the image is only opened when it is actually needed
+  ota_manifest_t manifest;
+  const ota_manifest_t *expected = NULL;
+  if (strlen(FIRMWARE_MANIFEST_URL) > 0)
+  {
+    bool update_needed = false;
+    esp_err_t manifest_err = check_manifest(&manifest, &update_needed);
+    if (manifest_err == ESP_ERR_NOT_FOUND)
+    {
+      ESP_LOGW(TAG, "No manifest on the server, reading the image header instead");
+    }
+    else if (manifest_err != ESP_OK)
+    {
+      ESP_LOGE(TAG, "Manifest check failed: %s", esp_err_to_name(manifest_err));
+      return;
+    }
+    else if (!update_needed)
+    {
+      return;
+    }
+    else
+    {
+      expected = &manifest;
+    }
+  }
+
+#ifdef CONFIG_ESP32_DELTA_OTA_ENABLED
+  if (expected != NULL && expected->patch_file[0] != '\0')
+  {
+    if (!wake_scheduler_extend(WAKE_JOB_OTA, OTA_DOWNLOAD_DEADLINE_MS))
+    {
+      ESP_LOGW(TAG, "OTA deadline already passed, not starting the download");
+      return;
+    }
+
+    power_mgmt_acquire(POWER_LOCK_TLS);
+    esp_err_t delta_err = apply_delta_update(expected);
+    power_mgmt_release(POWER_LOCK_TLS);
+    if (delta_err == ESP_OK)
+    {
+      restart_into_new_firmware();
+    }
+    ESP_LOGW(TAG, "Delta update failed (%s), downloading the full image", esp_err_to_name(delta_err));
+  }
+#endif
+
+#ifdef CONFIG_ESP32_COMPRESSED_OTA_ENABLED
+  if (expected != NULL && expected->compressed_file[0] != '\0')
+  {
+    if (!wake_scheduler_extend(WAKE_JOB_OTA, OTA_DOWNLOAD_DEADLINE_MS))
+    {
+      ESP_LOGW(TAG, "OTA deadline already passed, not starting the download");
+      return;
+    }
+
+    power_mgmt_acquire(POWER_LOCK_TLS);
+    esp_err_t compressed_err = apply_compressed_update(expected);
+    power_mgmt_release(POWER_LOCK_TLS);
+    if (compressed_err == ESP_OK)
+    {
+      restart_into_new_firmware();
+    }
+    ESP_LOGW(TAG, "Compressed update failed (%s), downloading the raw image", esp_err_to_name(compressed_err));
+  }
+#endif
+
+  // The downloads are TLS handshake, record decryption and flash writes
+  // throughout, so they run at full clock; the manifest check above only
+  // takes the lock for its handshake, inside https_get()
+  power_mgmt_acquire(POWER_LOCK_TLS);
+#ifdef CONFIG_ESP32_OTA_PIPELINED
+  esp_err_t err = pipelined_update(expected);
+#else
+  esp_err_t err = https_ota_update(expected);
+#endif
+  power_mgmt_release(POWER_LOCK_TLS);
+  if (err == ESP_OK)
+  {
+    restart_into_new_firmware();
+  }
+  ESP_LOGW(TAG, "No update installed (%s)", esp_err_to_name(err));
+}
+
+#endif // CONFIG_IS_ESP32_FIRMWARE_UPGRADE_ENABLED
+
+void ota_update_task(void *pvParameter)
+{
+  wake_outcome_t outcome = WAKE_OUTCOME_SKIPPED;
+
+  get_running_firmware_info();
+  check_current_firmware();
+
+#ifdef CONFIG_IS_ESP32_FIRMWARE_UPGRADE_ENABLED
+  ESP_LOGI(TAG, "OTA Updates enabled");
+  if (!(xEventGroupGetBits(global_event_group) & IS_WIFI_AVAILABLE)) {
+    ESP_LOGI(TAG, "Wi-Fi not available, skipping OTA check");
+    wake_profiler_mark(WAKE_PHASE_OTA_DONE);
+    wake_scheduler_complete(WAKE_JOB_OTA, WAKE_OUTCOME_SKIPPED);
+    vTaskDelete(NULL);
+    return;
+  }
+
+  ESP_LOGI(TAG, "Waiting for Wi-Fi connection...");
+  if (!wake_scheduler_wait_deps(WAKE_JOB_OTA))
+  {
+    ESP_LOGW(TAG, "No Wi-Fi connection, skipping OTA check");
+    wake_profiler_mark(WAKE_PHASE_OTA_DONE);
+    wake_scheduler_complete(WAKE_JOB_OTA, WAKE_OUTCOME_SKIPPED);
+    vTaskDelete(NULL);
+    return;
+  }
+
+  esp_read_mac(esp32_mac_address, ESP_MAC_EFUSE_FACTORY);
+  snprintf(esp32_mac_address_string, sizeof(esp32_mac_address_string), "%02X:%02X:%02X:%02X:%02X:%02X",
+           esp32_mac_address[0], esp32_mac_address[1], esp32_mac_address[2],
+           esp32_mac_address[3], esp32_mac_address[4], esp32_mac_address[5]);
+
+  wifi_power_begin(WIFI_POWER_INTERACTIVE);
+#ifdef CONFIG_ESP32_OTA_BENCHMARK
+  if (wake_scheduler_extend(WAKE_JOB_OTA, OTA_DOWNLOAD_DEADLINE_MS))
+  {
+    power_mgmt_acquire(POWER_LOCK_TLS);
+    run_download_benchmark();
+    power_mgmt_release(POWER_LOCK_TLS);
+  }
+#endif
   check_for_esp32_updates();
-  xEventGroupClearBits(global_event_group, IS_OTA_UPDATE_RUNNING);
+  wifi_power_end(WIFI_POWER_INTERACTIVE);
+  outcome = WAKE_OUTCOME_DONE;
 
   ESP_LOGI(TAG, "OTA check completed");
 #else
   ESP_LOGW(TAG, "OTA Updates disabled in SDK config");
 #endif
 
-  xEventGroupSetBits(global_event_group, IS_OTA_CHECK_DONE);
+  wake_profiler_mark(WAKE_PHASE_OTA_DONE);
+  wake_scheduler_complete(WAKE_JOB_OTA, outcome);
   vTaskDelete(NULL);
 }
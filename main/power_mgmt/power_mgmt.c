@@ -0,0 +1,84 @@
+/**
+ * @file power_mgmt.c
+ * @brief Dynamic frequency scaling and automatic light sleep while awake
+ */
+
+#include <sdkconfig.h>
+#include <esp_log.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <stdio.h>
+
+#include "power_mgmt.h"
+
+static const char *TAG = "power_mgmt";
+
+#ifdef CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t s_locks[POWER_LOCK_COUNT];
+
+static const char *lock_names[POWER_LOCK_COUNT] = {
+    [POWER_LOCK_WIFI] = "wifi",
+    [POWER_LOCK_TLS] = "tls",
+};
+#endif
+
+esp_err_t power_mgmt_init(void)
+{
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_config_t config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_XTAL_FREQ,
+#ifdef CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+
+    esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management (%s)", esp_err_to_name(err));
+        return err;
+    }
+
+    for (int lock = 0; lock < POWER_LOCK_COUNT; lock++) {
+        err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, lock_names[lock], &s_locks[lock]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create %s lock (%s)", lock_names[lock], esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    /* Pins armed with gpio_wakeup_enable() (display BUSY, trigger button) end a light sleep */
+    esp_sleep_enable_gpio_wakeup();
+
+    ESP_LOGI(TAG, "CPU %d-%d MHz, light sleep %s", config.min_freq_mhz, config.max_freq_mhz,
+             config.light_sleep_enable ? "on" : "off");
+#else
+    ESP_LOGI(TAG, "Power management disabled in SDK config");
+#endif
+    return ESP_OK;
+}
+
+void power_mgmt_acquire(power_lock_t lock)
+{
+#ifdef CONFIG_PM_ENABLE
+    if (lock < POWER_LOCK_COUNT && s_locks[lock] != NULL) {
+        esp_pm_lock_acquire(s_locks[lock]);
+    }
+#endif
+}
+
+void power_mgmt_release(power_lock_t lock)
+{
+#ifdef CONFIG_PM_ENABLE
+    if (lock < POWER_LOCK_COUNT && s_locks[lock] != NULL) {
+        esp_pm_lock_release(s_locks[lock]);
+    }
+#endif
+}
+
+void power_mgmt_dump(void)
+{
+#ifdef CONFIG_PM_PROFILING
+    esp_pm_dump_locks(stdout);
+#endif
+}
@@ -0,0 +1,55 @@
+/**
+ * @file power_mgmt.h
+ * @brief Dynamic frequency scaling and automatic light sleep while awake
+ *
+ * With CONFIG_PM_ENABLE the CPU runs at the XTAL frequency and light-sleeps
+ * whenever every task is blocked. Work that needs the full clock holds a
+ * lock for as long as it is active. Without CONFIG_PM_ENABLE every call is
+ * a no-op.
+ */
+
+#ifndef POWER_MGMT_H
+#define POWER_MGMT_H
+
+#include <esp_err.h>
+
+/**
+ * @brief Activities that need the CPU at full frequency
+ */
+typedef enum {
+    POWER_LOCK_WIFI,                /**< Wi-Fi association, DHCP and readiness probe */
+    POWER_LOCK_TLS,                 /**< TLS handshakes, OTA downloads and image hashing */
+    POWER_LOCK_COUNT,
+} power_lock_t;
+
+/**
+ * @brief Configure esp_pm and create the locks
+ *
+ * Call once from app_main() before any task takes a lock.
+ *
+ * @return ESP_OK on success (or when power management is disabled),
+ *         error code from esp_pm otherwise
+ */
+esp_err_t power_mgmt_init(void);
+
+/**
+ * @brief Hold the CPU at full frequency and keep it out of light sleep
+ *
+ * Calls nest; the lock is held until every acquire has been released.
+ *
+ * @param lock Activity taking the lock
+ */
+void power_mgmt_acquire(power_lock_t lock);
+
+/**
+ * @brief Release a lock taken with power_mgmt_acquire()
+ * @param lock Activity releasing the lock
+ */
+void power_mgmt_release(power_lock_t lock);
+
+/**
+ * @brief Log how long each lock and power mode was held (CONFIG_PM_PROFILING)
+ */
+void power_mgmt_dump(void);
+
+#endif // POWER_MGMT_H
@@ -0,0 +1,239 @@
+/**
+ * @file rtc_state.c
+ * @brief Persistent device state kept in RTC memory with write-through to NVS
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include <esp_attr.h>
+#include <esp_rom_crc.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "rtc_state.h"
+#include "../nvs_utils/nvs_utils.h"
+
+static const char *TAG = "rtc_state";
+
+/* Bump when the layout of rtc_state_t changes */
+#define RTC_STATE_VERSION 4
+
+/* NVS locations; must match set_manual_timestamp/set_timestamp.py */
+#define NVS_TRIGGER_NAMESPACE "trigger_info"
+#define NVS_LAST_TRIGGER_KEY "last_gpio4"
+#define NVS_SNTP_NAMESPACE "sntp_info"
+#define NVS_FIRST_SYNC_KEY "first_sync"
+#define NVS_OTA_NAMESPACE "ota_info"
+#define NVS_OTA_FIRMWARE_KEY "firmware"
+#define NVS_OTA_MANIFEST_KEY "manifest"
+#define NVS_WIFI_NAMESPACE "wifi_info"
+#define NVS_WIFI_CACHE_KEY "ap_cache"
+
+typedef struct {
+    uint32_t version;
+    time_t last_trigger;
+    uint8_t first_sync_done;
+    uint8_t firmware_found;
+    rtc_state_firmware_t firmware;
+    uint8_t manifest_found;
+    rtc_state_manifest_t manifest;
+    uint8_t wifi_found;
+    rtc_state_wifi_t wifi;
+    uint32_t crc;                           /* Over every field above */
+} rtc_state_t;
+
+RTC_DATA_ATTR static rtc_state_t s_state;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t rtc_state_crc(const rtc_state_t *state)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)state, offsetof(rtc_state_t, crc));
+}
+
+static bool rtc_state_valid(void)
+{
+    return s_state.version == RTC_STATE_VERSION && s_state.crc == rtc_state_crc(&s_state);
+}
+
+/* Call with s_lock held after every change */
+static void rtc_state_seal(void)
+{
+    s_state.version = RTC_STATE_VERSION;
+    s_state.crc = rtc_state_crc(&s_state);
+}
+
+static esp_err_t rtc_state_load_from_nvs(void)
+{
+    esp_err_t err = nvs_utils_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    rtc_state_t state;
+    uint8_t first_sync_done = 0;
+    memset(&state, 0, sizeof(state));
+
+    if (nvs_utils_read_timestamp(NVS_TRIGGER_NAMESPACE, NVS_LAST_TRIGGER_KEY, &state.last_trigger) != ESP_OK) {
+        state.last_trigger = 0;
+    }
+    if (nvs_utils_read_u8(NVS_SNTP_NAMESPACE, NVS_FIRST_SYNC_KEY, &first_sync_done) == ESP_OK) {
+        state.first_sync_done = (first_sync_done == 1);
+    }
+    if (nvs_utils_read_blob(NVS_OTA_NAMESPACE, NVS_OTA_FIRMWARE_KEY, &state.firmware, sizeof(state.firmware)) == ESP_OK) {
+        state.firmware_found = 1;
+    }
+    if (nvs_utils_read_blob(NVS_OTA_NAMESPACE, NVS_OTA_MANIFEST_KEY, &state.manifest, sizeof(state.manifest)) == ESP_OK) {
+        state.manifest_found = 1;
+    }
+    if (nvs_utils_read_blob(NVS_WIFI_NAMESPACE, NVS_WIFI_CACHE_KEY, &state.wifi, sizeof(state.wifi)) == ESP_OK) {
+        state.wifi_found = 1;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_state = state;
+    rtc_state_seal();
+    portEXIT_CRITICAL(&s_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t rtc_state_init(esp_sleep_wakeup_cause_t wakeup_cause)
+{
+    /* The bootloader reloads RTC data on every boot except a deep-sleep wake-up */
+    if (wakeup_cause != ESP_SLEEP_WAKEUP_UNDEFINED) {
+        if (rtc_state_valid()) {
+            ESP_LOGI(TAG, "State restored from RTC memory, NVS not needed");
+            return ESP_OK;
+        }
+        ESP_LOGW(TAG, "RTC state failed version/CRC check, reloading from NVS");
+    }
+
+    esp_err_t err = rtc_state_load_from_nvs();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to load state from NVS (%s)", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG, "State loaded from NVS");
+    return ESP_OK;
+}
+
+time_t rtc_state_get_last_trigger(void)
+{
+    return s_state.last_trigger;
+}
+
+esp_err_t rtc_state_set_last_trigger(time_t timestamp)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_state.last_trigger = timestamp;
+    rtc_state_seal();
+    portEXIT_CRITICAL(&s_lock);
+
+    return nvs_utils_write_timestamp(NVS_TRIGGER_NAMESPACE, NVS_LAST_TRIGGER_KEY, timestamp);
+}
+
+bool rtc_state_get_first_sync_done(void)
+{
+    return s_state.first_sync_done != 0;
+}
+
+esp_err_t rtc_state_set_first_sync_done(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_state.first_sync_done = 1;
+    rtc_state_seal();
+    portEXIT_CRITICAL(&s_lock);
+
+    return nvs_utils_write_u8(NVS_SNTP_NAMESPACE, NVS_FIRST_SYNC_KEY, 1);
+}
+
+bool rtc_state_get_firmware_hash(rtc_state_firmware_t *firmware)
+{
+    if (!s_state.firmware_found) {
+        return false;
+    }
+    portENTER_CRITICAL(&s_lock);
+    *firmware = s_state.firmware;
+    portEXIT_CRITICAL(&s_lock);
+    return true;
+}
+
+esp_err_t rtc_state_set_firmware_hash(const rtc_state_firmware_t *firmware)
+{
+    bool changed = false;
+
+    portENTER_CRITICAL(&s_lock);
+    if (!s_state.firmware_found || memcmp(&s_state.firmware, firmware, sizeof(*firmware)) != 0) {
+        s_state.firmware = *firmware;
+        s_state.firmware_found = 1;
+        rtc_state_seal();
+        changed = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!changed) {
+        return ESP_OK;
+    }
+    return nvs_utils_write_blob(NVS_OTA_NAMESPACE, NVS_OTA_FIRMWARE_KEY, firmware, sizeof(*firmware));
+}
+
+bool rtc_state_get_manifest(rtc_state_manifest_t *manifest)
+{
+    if (!s_state.manifest_found) {
+        return false;
+    }
+    portENTER_CRITICAL(&s_lock);
+    *manifest = s_state.manifest;
+    portEXIT_CRITICAL(&s_lock);
+    return true;
+}
+
+esp_err_t rtc_state_set_manifest(const rtc_state_manifest_t *manifest)
+{
+    bool changed = false;
+
+    portENTER_CRITICAL(&s_lock);
+    if (!s_state.manifest_found || memcmp(&s_state.manifest, manifest, sizeof(*manifest)) != 0) {
+        s_state.manifest = *manifest;
+        s_state.manifest_found = 1;
+        rtc_state_seal();
+        changed = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!changed) {
+        return ESP_OK;
+    }
+    return nvs_utils_write_blob(NVS_OTA_NAMESPACE, NVS_OTA_MANIFEST_KEY, manifest, sizeof(*manifest));
+}
+
+bool rtc_state_get_wifi(rtc_state_wifi_t *wifi)
+{
+    if (!s_state.wifi_found) {
+        return false;
+    }
+    portENTER_CRITICAL(&s_lock);
+    *wifi = s_state.wifi;
+    portEXIT_CRITICAL(&s_lock);
+    return true;
+}
+
+esp_err_t rtc_state_set_wifi(const rtc_state_wifi_t *wifi)
+{
+    bool changed = false;
+
+    portENTER_CRITICAL(&s_lock);
+    if (!s_state.wifi_found || memcmp(&s_state.wifi, wifi, sizeof(*wifi)) != 0) {
+        s_state.wifi = *wifi;
+        s_state.wifi_found = 1;
+        rtc_state_seal();
+        changed = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!changed) {
+        return ESP_OK;
+    }
+    return nvs_utils_write_blob(NVS_WIFI_NAMESPACE, NVS_WIFI_CACHE_KEY, wifi, sizeof(*wifi));
+}
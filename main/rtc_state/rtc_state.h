@@ -0,0 +1,141 @@
+/**
+ * @file rtc_state.h
+ * @brief Persistent device state kept in RTC memory with write-through to NVS
+ *
+ * The state survives deep sleep in RTC memory, so a normal wake reads it
+ * without touching flash. NVS is only initialized and read on a cold boot or
+ * when the RTC copy fails its version or CRC check. Every change is written
+ * to RTC memory and NVS together.
+ */
+
+#ifndef RTC_STATE_H
+#define RTC_STATE_H
+
+#include <esp_err.h>
+#include <esp_sleep.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define RTC_STATE_HASH_LEN 32
+#define RTC_STATE_SSID_LEN 33
+#define RTC_STATE_ETAG_LEN 64
+#define RTC_STATE_VERSION_LEN 32
+
+/**
+ * @brief Access point and DHCP lease of the last successful Wi-Fi connection
+ *
+ * IPv4 addresses are in network byte order, as in esp_ip4_addr_t.
+ */
+typedef struct {
+    char ssid[RTC_STATE_SSID_LEN];  /**< SSID the entry belongs to */
+    uint8_t bssid[6];               /**< BSSID of the access point */
+    uint8_t channel;                /**< Primary channel of the access point */
+    uint32_t ip;                    /**< Leased address */
+    uint32_t netmask;               /**< Subnet mask of the lease */
+    uint32_t gw;                    /**< Gateway of the lease */
+    uint32_t dns;                   /**< Main DNS server of the lease */
+} rtc_state_wifi_t;
+
+/**
+ * @brief Restore the state from RTC memory, or load it from NVS
+ *
+ * @param wakeup_cause Wake-up cause of this boot; RTC memory is only trusted
+ *                     after a deep-sleep wake-up
+ * @return ESP_OK on success, error code if NVS could not be initialized
+ */
+esp_err_t rtc_state_init(esp_sleep_wakeup_cause_t wakeup_cause);
+
+/**
+ * @brief Get the last trigger (GPIO4) timestamp
+ * @return Timestamp, or 0 if the trigger was never pressed
+ */
+time_t rtc_state_get_last_trigger(void);
+
+/**
+ * @brief Set the last trigger (GPIO4) timestamp
+ * @param timestamp Timestamp to store
+ * @return ESP_OK on success, error code if the NVS write failed
+ */
+esp_err_t rtc_state_set_last_trigger(time_t timestamp);
+
+/**
+ * @brief Check whether time has ever been synced over SNTP
+ * @return true if a sync has completed at least once
+ */
+bool rtc_state_get_first_sync_done(void);
+
+/**
+ * @brief Record that time has been synced over SNTP
+ * @return ESP_OK on success, error code if the NVS write failed
+ */
+esp_err_t rtc_state_set_first_sync_done(void);
+
+/**
+ * @brief Firmware recorded by the OTA module and the hash of its partition
+ *
+ * Keyed by the app descriptor, so the partition is only hashed again when a
+ * different image is running.
+ */
+typedef struct {
+    uint8_t app_elf_sha256[RTC_STATE_HASH_LEN];     /**< ELF SHA-256 from the app descriptor */
+    char version[RTC_STATE_VERSION_LEN];            /**< Version from the app descriptor */
+    uint32_t partition_address;                     /**< Flash address of the app partition */
+    uint8_t partition_sha256[RTC_STATE_HASH_LEN];   /**< esp_partition_get_sha256() of it */
+} rtc_state_firmware_t;
+
+/**
+ * @brief Get the firmware recorded by the OTA module
+ * @param firmware Filled in on success
+ * @return true if a firmware has been recorded, false otherwise
+ */
+bool rtc_state_get_firmware_hash(rtc_state_firmware_t *firmware);
+
+/**
+ * @brief Record a firmware and its partition hash; NVS is only written when it changes
+ * @param firmware Entry to store
+ * @return ESP_OK on success, error code if the NVS write failed
+ */
+esp_err_t rtc_state_set_firmware_hash(const rtc_state_firmware_t *firmware);
+
+/**
+ * @brief OTA manifest that last reported no update was needed
+ */
+typedef struct {
+    char etag[RTC_STATE_ETAG_LEN];                  /**< ETag the server sent with it */
+    uint8_t firmware_hash[RTC_STATE_HASH_LEN];      /**< Running firmware it was checked against */
+} rtc_state_manifest_t;
+
+/**
+ * @brief Get the cached OTA manifest ETag
+ * @param manifest Filled in on success
+ * @return true if an ETag has been cached, false otherwise
+ */
+bool rtc_state_get_manifest(rtc_state_manifest_t *manifest);
+
+/**
+ * @brief Cache the OTA manifest ETag; NVS is only written when it changes
+ * @param manifest Entry to store
+ * @return ESP_OK on success, error code if the NVS write failed
+ */
+esp_err_t rtc_state_set_manifest(const rtc_state_manifest_t *manifest);
+
+/**
+ * @brief Get the cached access point and DHCP lease
+ * @param wifi Filled in on success
+ * @return true if a connection has been cached, false otherwise
+ */
+bool rtc_state_get_wifi(rtc_state_wifi_t *wifi);
+
+/**
+ * @brief Cache the access point and DHCP lease of a successful connection
+ *
+ * NVS is only written when the entry differs from the cached one, so
+ * reconnecting to the same AP with the same lease costs no flash write.
+ *
+ * @param wifi Entry to store
+ * @return ESP_OK on success, error code if the NVS write failed
+ */
+esp_err_t rtc_state_set_wifi(const rtc_state_wifi_t *wifi);
+
+#endif /* RTC_STATE_H */
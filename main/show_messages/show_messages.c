@@ -13,15 +13,47 @@
 #include "../display_epaper/display.h"
 #include "../deep_sleep/deep_sleep.h"
 #include "../trigger/trigger.h"
+#include "../sntp/sntp.h"
 #include "../time_utils/time_utils.h"
+#include "../wake_scheduler/wake_scheduler.h"
 #include "show_messages.h"
 
 static const char *TAG = "show_messages";
 
-static void handle_trigger_press(char *datetime_str, size_t buf_size)
+static void display_update_done(esp_err_t result, void *arg)
 {
-    time_t now = 0;
-    time(&now);
+    if (result != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to update display (%s)", esp_err_to_name(result));
+    } else {
+        ESP_LOGI(TAG, "Display update completed");
+    }
+}
+
+/* Runs on the display update task once the last frame is on a sleeping panel */
+static void display_sequence_done(esp_err_t result, void *arg)
+{
+    display_update_done(result, arg);
+    ESP_LOGI(TAG, "Display sequence completed");
+    wake_scheduler_complete(WAKE_JOB_DISPLAY, result == ESP_OK ? WAKE_OUTCOME_DONE : WAKE_OUTCOME_FAILED);
+}
+
+/* Later display calls wait for the queued refresh themselves. The last frame
+ * of the sequence also puts the panel to sleep and finishes the display job. */
+static void queue_display_update(bool last)
+{
+    esp_err_t ret = last ? display_update_async(display_sequence_done, NULL, true)
+                         : display_update_async(display_update_done, NULL, false);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to queue display update");
+        if (last) {
+            wake_scheduler_complete(WAKE_JOB_DISPLAY, WAKE_OUTCOME_FAILED);
+        }
+    }
+}
+
+static void handle_trigger_press(const trigger_event_t *event, char *datetime_str, size_t buf_size)
+{
+    time_t now = trigger_event_time(event);
 
     trigger_save_timestamp(now);
     ESP_LOGI(TAG, "Trigger pressed: saved timestamp %ld", (long)now);
@@ -40,6 +72,14 @@ static void handle_trigger_press(char *datetime_str, size_t buf_size)
     display_sleep();
 }
 
+static void handle_trigger_events(char *datetime_str, size_t buf_size)
+{
+    trigger_event_t event;
+    while (trigger_receive_event(&event, 0)) {
+        handle_trigger_press(&event, datetime_str, buf_size);
+    }
+}
+
 static void get_trigger_info(bool is_gpio4_wakeup, time_t now, int *days_since, time_t *timestamp)
 {
     if (is_gpio4_wakeup) {
@@ -54,16 +94,52 @@ static void get_trigger_info(bool is_gpio4_wakeup, time_t now, int *days_since,
     }
 }
 
-void show_messages_task(void *pvParameter)
+void show_messages_timer_wake(void)
 {
-    ESP_LOGI(TAG, "Show messages task started");
+    ESP_LOGI(TAG, "Timer wake-up without Wi-Fi: single-task fast path");
 
-    if (display_init() != ESP_OK) {
+    time_utils_init_timezone();
+
+    char datetime_str[64];
+    time_t now = 0;
+    time(&now);
+
+    if (sntp_check_first_sync_done() && time_utils_is_valid()) {
+        int days_since_trigger = 0;
+        time_t trigger_timestamp = 0;
+        get_trigger_info(false, now, &days_since_trigger, &trigger_timestamp);
+        trigger_format_datetime(datetime_str, sizeof(datetime_str), days_since_trigger, trigger_timestamp);
+    } else {
+        snprintf(datetime_str, sizeof(datetime_str), " Підключаю\n Wi-Fi для\n отримання\n часу");
+    }
+
+    if (display_init() == ESP_OK) {
+        display_clear();
+        display_draw_text(0, 0, datetime_str, 0);
+
+        if (display_update() != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to update display");
+        } else {
+            ESP_LOGI(TAG, "Display updated: %s", datetime_str);
+        }
+        display_sleep();
+    } else {
         ESP_LOGE(TAG, "Failed to initialize display");
+    }
+
+    /* Without wake-up sources the device would never wake again; stay awake
+     * like show_messages_task() does */
+    if (deep_sleep_configure_wakeup() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure deep sleep");
         vTaskDelete(NULL);
     }
+    deep_sleep_enter();
+}
 
-    char datetime_str[64];
+/* Initial frame, plus the synced one on first boot. Returns once the last
+ * frame is queued; the display job finishes when it is on the panel. */
+static void show_initial_messages(char *datetime_str, size_t buf_size)
+{
     bool first_boot = false;
 
     /* Check if SNTP has synced before */
@@ -83,99 +159,79 @@ void show_messages_task(void *pvParameter)
 
     if (valid_time) {
         get_trigger_info(is_gpio4_wakeup, now, &days_since_trigger, &trigger_timestamp);
-        trigger_format_datetime(datetime_str, sizeof(datetime_str), days_since_trigger, trigger_timestamp);
+        trigger_format_datetime(datetime_str, buf_size, days_since_trigger, trigger_timestamp);
     } else {
         ESP_LOGI(TAG, "First boot, showing connecting message");
-        snprintf(datetime_str, sizeof(datetime_str), " Підключаю\n Wi-Fi для\n отримання\n часу");
+        snprintf(datetime_str, buf_size, " Підключаю\n Wi-Fi для\n отримання\n часу");
         first_boot = true;
     }
 
     display_clear();
     display_draw_text(0, 0, datetime_str, 0);
 
-    if (display_update() != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to update display");
-        display_deinit();
-        vTaskDelete(NULL);
-        return;
-    }
-
-    ESP_LOGI(TAG, "Display updated: %s", datetime_str);
+    /* The panel refreshes in the background while the rest of the wake continues */
+    queue_display_update(!first_boot);
+    ESP_LOGI(TAG, "Display update queued: %s", datetime_str);
 
     /* On first boot, show saved date immediately, then update after SNTP sync */
     if (first_boot) {
         /* Show the saved trigger date/time without relative days (time not synced yet) */
         trigger_timestamp = trigger_get_last_timestamp();
         if (trigger_timestamp != 0) {
-            trigger_format_datetime(datetime_str, sizeof(datetime_str), -1, trigger_timestamp);
+            trigger_format_datetime(datetime_str, buf_size, -1, trigger_timestamp);
             display_clear();
             display_draw_text(0, 0, datetime_str, 0);
-            if (display_update() != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to update display with saved time");
-            } else {
-                ESP_LOGI(TAG, "Display updated with saved time (no days): %s", datetime_str);
-            }
+            queue_display_update(false);
+            ESP_LOGI(TAG, "Display update queued with saved time (no days): %s", datetime_str);
         }
 
+        /* Bounded by the SNTP job's deadline */
         ESP_LOGI(TAG, "Waiting for SNTP sync...");
-        xEventGroupWaitBits(global_event_group, IS_SNTP_SYNC_DONE, pdFALSE, pdTRUE, portMAX_DELAY);
+        wake_scheduler_wait(WAKE_JOB_BIT(WAKE_JOB_SNTP), 0);
 
         time(&now);
         if (time_utils_is_valid()) {
             get_trigger_info(is_gpio4_wakeup, now, &days_since_trigger, &trigger_timestamp);
-            trigger_format_datetime(datetime_str, sizeof(datetime_str), days_since_trigger, trigger_timestamp);
+            trigger_format_datetime(datetime_str, buf_size, days_since_trigger, trigger_timestamp);
 
             display_clear();
             display_draw_text(0, 0, datetime_str, 0);
-
-            if (display_update() != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to update display with time");
-            } else {
-                ESP_LOGI(TAG, "Display updated with synced time: %s", datetime_str);
-            }
+            ESP_LOGI(TAG, "Display update queued with synced time: %s", datetime_str);
         } else {
-            ESP_LOGW(TAG, "SNTP sync completed but time still invalid, skipping days display");
+            /* The unchanged frame skips the refresh and only sleeps the panel */
+            ESP_LOGW(TAG, "No valid time after SNTP, skipping days display");
         }
+        queue_display_update(true);
     }
+}
 
-    display_sleep();
-    ESP_LOGI(TAG, "Display sequence completed");
-
-    /* Configure trigger interrupt for button presses while awake */
-    trigger_init_interrupt();
-
-    /* Wait for OTA and SNTP to complete, polling for trigger presses */
-    ESP_LOGI(TAG, "Waiting for OTA and SNTP (1 min timeout)...");
-    const TickType_t poll_interval = pdMS_TO_TICKS(100);
-    const TickType_t max_wait = pdMS_TO_TICKS(60000);
-    TickType_t elapsed = 0;
-    EventBits_t wait_bits = 0;
-
-    while (elapsed < max_wait) {
-        if (trigger_check_and_clear()) {
-            handle_trigger_press(datetime_str, sizeof(datetime_str));
-        }
+void show_messages_task(void *pvParameter)
+{
+    ESP_LOGI(TAG, "Show messages task started");
 
-        wait_bits = xEventGroupWaitBits(global_event_group,
-                                        IS_OTA_CHECK_DONE | IS_SNTP_SYNC_DONE,
-                                        pdFALSE, pdTRUE, poll_interval);
+    char datetime_str[64];
+    bool display_ready = display_init() == ESP_OK;
 
-        if ((wait_bits & (IS_OTA_CHECK_DONE | IS_SNTP_SYNC_DONE)) == (IS_OTA_CHECK_DONE | IS_SNTP_SYNC_DONE)) {
-            break;
-        }
+    if (!display_ready) {
+        ESP_LOGE(TAG, "Failed to initialize display");
+        wake_scheduler_complete(WAKE_JOB_DISPLAY, WAKE_OUTCOME_FAILED);
+    } else {
+        show_initial_messages(datetime_str, sizeof(datetime_str));
+    }
 
-        elapsed += poll_interval;
+    /* Sleep as soon as every job has finished or passed its deadline;
+     * presses queued since boot are handled as they arrive */
+    ESP_LOGI(TAG, "Waiting for remaining wake jobs...");
+    while (!wake_scheduler_wait(WAKE_JOBS_ALL, IS_TRIGGER_EVENT)) {
+        handle_trigger_events(datetime_str, sizeof(datetime_str));
     }
+    handle_trigger_events(datetime_str, sizeof(datetime_str));
+    wake_scheduler_log();
 
-    /* If OTA update is running, wait for completion */
-    if (wait_bits & IS_OTA_UPDATE_RUNNING) {
-        ESP_LOGI(TAG, "OTA update in progress, waiting...");
-        while (!(xEventGroupGetBits(global_event_group) & IS_OTA_CHECK_DONE)) {
-            if (trigger_check_and_clear()) {
-                handle_trigger_press(datetime_str, sizeof(datetime_str));
-            }
-            vTaskDelay(poll_interval);
-        }
+    /* A refresh that outlived the display job's deadline still has to finish
+     * before the panel loses power */
+    if (display_ready) {
+        display_sleep();
     }
 
     trigger_deinit_interrupt();
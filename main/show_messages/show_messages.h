@@ -1 +1,7 @@
 void show_messages_task(void *pvParameter);
+
+/* Render the current day count and deep-sleep from the calling task, without
+ * starting the Wi-Fi, SNTP, OTA and battery tasks. Used on timer wake-ups when
+ * Wi-Fi is not needed. Does not return; if the wake-up sources can't be
+ * configured, the calling task is deleted and the device stays awake. */
+void show_messages_timer_wake(void);
@@ -6,31 +6,29 @@
 #include <time.h>
 
 #include "global_event_group.h"
-#include "../nvs_utils/nvs_utils.h"
+#include "../rtc_state/rtc_state.h"
 #include "../time_utils/time_utils.h"
+#include "../wake_profiler/wake_profiler.h"
+#include "../wake_scheduler/wake_scheduler.h"
+#include "../wifi/wifi.h"
 #include "sntp.h"
 
 static const char *TAG = "SNTP";
 static bool sntp_initialized = false;
 
-#define NVS_SNTP_NAMESPACE "sntp_info"
-#define NVS_FIRST_SYNC_KEY "first_sync"
-
 bool sntp_check_first_sync_done(void)
 {
-    uint8_t first_sync_done = 0;
-    esp_err_t err = nvs_utils_read_u8(NVS_SNTP_NAMESPACE, NVS_FIRST_SYNC_KEY, &first_sync_done);
-    return (err == ESP_OK && first_sync_done == 1);
+    return rtc_state_get_first_sync_done();
 }
 
 static void sntp_save_first_sync_done(void)
 {
-    if (nvs_utils_write_u8(NVS_SNTP_NAMESPACE, NVS_FIRST_SYNC_KEY, 1) == ESP_OK) {
+    if (rtc_state_set_first_sync_done() == ESP_OK) {
         ESP_LOGI(TAG, "First SNTP sync flag saved");
     }
 }
 
-static void sync_time_with_sntp(void)
+static esp_err_t sync_time_with_sntp(void)
 {
     const TickType_t sync_wait_ticks = pdMS_TO_TICKS(10000);
 
@@ -59,6 +57,7 @@ static void sync_time_with_sntp(void)
     } else {
         ESP_LOGW(TAG, "SNTP sync failed (%s)", esp_err_to_name(sync_err));
     }
+    return sync_err;
 }
 
 void sntp_task(void *pvParameter)
@@ -76,16 +75,26 @@ void sntp_task(void *pvParameter)
 
     if (!(xEventGroupGetBits(global_event_group) & IS_WIFI_AVAILABLE)) {
         ESP_LOGI(TAG, "Wi-Fi not available, skipping time sync");
-        xEventGroupSetBits(global_event_group, IS_SNTP_SYNC_DONE);
+        wake_profiler_mark(WAKE_PHASE_SNTP_DONE);
+        wake_scheduler_complete(WAKE_JOB_SNTP, WAKE_OUTCOME_SKIPPED);
         vTaskDelete(NULL);
         return;
     }
 
     ESP_LOGI(TAG, "Waiting for Wi-Fi connection...");
-    xEventGroupWaitBits(global_event_group, IS_WIFI_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+    if (!wake_scheduler_wait_deps(WAKE_JOB_SNTP)) {
+        ESP_LOGW(TAG, "No Wi-Fi connection, skipping time sync");
+        wake_profiler_mark(WAKE_PHASE_SNTP_DONE);
+        wake_scheduler_complete(WAKE_JOB_SNTP, WAKE_OUTCOME_SKIPPED);
+        vTaskDelete(NULL);
+        return;
+    }
 
     ESP_LOGI(TAG, "Wi-Fi connected, syncing time");
-    sync_time_with_sntp();
+    /* A few small packets: min modem sleep only adds a beacon interval of latency */
+    wifi_power_begin(WIFI_POWER_INTERACTIVE);
+    esp_err_t sync_err = sync_time_with_sntp();
+    wifi_power_end(WIFI_POWER_INTERACTIVE);
 
     /* Save first sync flag if not already saved */
     if (!sntp_check_first_sync_done()) {
@@ -93,7 +102,8 @@ void sntp_task(void *pvParameter)
         xEventGroupSetBits(global_event_group, IS_SNTP_FIRST_SYNC_DONE);
     }
 
-    xEventGroupSetBits(global_event_group, IS_SNTP_SYNC_DONE);
+    wake_profiler_mark(WAKE_PHASE_SNTP_DONE);
+    wake_scheduler_complete(WAKE_JOB_SNTP, sync_err == ESP_OK ? WAKE_OUTCOME_DONE : WAKE_OUTCOME_FAILED);
     ESP_LOGI(TAG, "SNTP sync done");
 
     vTaskDelete(NULL);
@@ -5,6 +5,8 @@
 #include <esp_heap_caps.h>
 #include <nvs.h>
 
+#include "../nvs_utils/nvs_utils.h"
+
 static const char *NVS_STORAGE_NAMESPACE = "system_info";
 static const char *NVS_UPTIME_KEY = "uptime_bfr_heap";
 static const char *TAG = "System State";
@@ -105,7 +107,11 @@ void show_last_uptime_before_out_of_memory()
   uint32_t last_uptime_before_out_of_memory;
   size_t required_size = sizeof(last_uptime_before_out_of_memory);
 
-  esp_err_t err = nvs_open(NVS_STORAGE_NAMESPACE, NVS_READONLY, &uptime_storage_handle);
+  esp_err_t err = nvs_utils_init();
+  if (err == ESP_OK)
+  {
+    err = nvs_open(NVS_STORAGE_NAMESPACE, NVS_READONLY, &uptime_storage_handle);
+  }
   if (err != ESP_OK)
   {
     return;
@@ -146,7 +152,11 @@ static void restart_if_free_heap_low()
 
   if (free_heap_kb < AUTO_RESTART_IF_HEAP_LESS_KB)
   {
-    esp_err_t err = nvs_open(NVS_STORAGE_NAMESPACE, NVS_READWRITE, &uptime_storage_handle);
+    esp_err_t err = nvs_utils_init();
+    if (err == ESP_OK)
+    {
+      err = nvs_open(NVS_STORAGE_NAMESPACE, NVS_READWRITE, &uptime_storage_handle);
+    }
     if (err != ESP_OK)
     {
       return;
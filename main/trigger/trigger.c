@@ -6,48 +6,96 @@
 #include <sdkconfig.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
 #include <esp_log.h>
 #include <driver/gpio.h>
+#include <hal/gpio_ll.h>
 #include <stdio.h>
 #include <time.h>
 
 #include "trigger.h"
-#include "../nvs_utils/nvs_utils.h"
+#include "../global_event_group.h"
+#include "../rtc_state/rtc_state.h"
 #include "../time_utils/time_utils.h"
 
 static const char *TAG = "trigger";
 
 #define TRIGGER_GPIO CONFIG_BUTTON_RIGHT_GPIO
 #define TRIGGER_DEBOUNCE_MS 200
+#define TRIGGER_QUEUE_LEN 8
 
-#define NVS_TRIGGER_NAMESPACE "trigger_info"
-#define NVS_LAST_TRIGGER_KEY "last_gpio4"
-
-static volatile bool s_triggered = false;
-static TickType_t s_last_press_time = 0;
+static QueueHandle_t s_event_queue = NULL;
+static TickType_t s_last_edge_time;    /* Only touched by the ISR once it is installed */
+#ifdef CONFIG_PM_ENABLE
+/* Light-sleep wakeup needs a level interrupt, so the ISR arms LOW for the
+ * next press and HIGH for its release instead of firing while it is held */
+static gpio_int_type_t s_armed_level = GPIO_INTR_LOW_LEVEL;
+#endif
 
 static void IRAM_ATTR trigger_isr_handler(void *arg)
 {
+#ifdef CONFIG_PM_ENABLE
+    bool released = s_armed_level == GPIO_INTR_HIGH_LEVEL;
+    s_armed_level = released ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL;
+    /* The wakeup level follows the interrupt type */
+    gpio_ll_set_intr_type(GPIO_LL_GET_HW(GPIO_PORT_0), TRIGGER_GPIO, s_armed_level);
+#else
+    bool released = gpio_ll_get_level(GPIO_LL_GET_HW(GPIO_PORT_0), TRIGGER_GPIO) != 0;
+#endif
+
+    /* The release restarts the debounce window, so the contact bouncing
+     * as it opens is not taken for another press */
     TickType_t current_time = xTaskGetTickCountFromISR();
-    if ((current_time - s_last_press_time) > pdMS_TO_TICKS(TRIGGER_DEBOUNCE_MS)) {
-        s_triggered = true;
-        s_last_press_time = current_time;
+    if (released) {
+        s_last_edge_time = current_time;
+        return;
+    }
+    if ((current_time - s_last_edge_time) <= pdMS_TO_TICKS(TRIGGER_DEBOUNCE_MS)) {
+        return;
+    }
+    s_last_edge_time = current_time;
+
+    const trigger_event_t event = { .tick = current_time };
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    if (xQueueSendFromISR(s_event_queue, &event, &higher_priority_task_woken) == pdTRUE) {
+        xEventGroupSetBitsFromISR(global_event_group, IS_TRIGGER_EVENT, &higher_priority_task_woken);
+    }
+    if (higher_priority_task_woken == pdTRUE) {
+        portYIELD_FROM_ISR();
     }
 }
 
-void trigger_init_interrupt(void)
+void trigger_init_interrupt(bool gpio4_wakeup)
 {
+    if (s_event_queue == NULL) {
+        s_event_queue = xQueueCreate(TRIGGER_QUEUE_LEN, sizeof(trigger_event_t));
+        if (s_event_queue == NULL) {
+            ESP_LOGE(TAG, "Failed to create trigger event queue");
+            return;
+        }
+    }
+
     gpio_config_t io_conf = {
         .pin_bit_mask = (1ULL << TRIGGER_GPIO),
         .mode = GPIO_MODE_INPUT,
         .pull_up_en = GPIO_PULLUP_ENABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_NEGEDGE
+        .intr_type = GPIO_INTR_ANYEDGE
     };
     gpio_config(&io_conf);
 
+    /* The press that woke the device counts as made at boot, so its bounces
+     * are debounced; otherwise the first press is accepted right away */
+    s_last_edge_time = gpio4_wakeup ? 0 : xTaskGetTickCount() - pdMS_TO_TICKS(TRIGGER_DEBOUNCE_MS) - 1;
+
     gpio_install_isr_service(0);
     gpio_isr_handler_add(TRIGGER_GPIO, trigger_isr_handler, NULL);
+#ifdef CONFIG_PM_ENABLE
+    /* Edge interrupts alone don't end an automatic light sleep. A button
+     * still held from the wake-up press is armed for its release first. */
+    s_armed_level = gpio_get_level(TRIGGER_GPIO) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL;
+    gpio_wakeup_enable(TRIGGER_GPIO, s_armed_level);
+#endif
 
     ESP_LOGI(TAG, "GPIO4 interrupt configured");
 }
@@ -55,30 +103,41 @@ void trigger_init_interrupt(void)
 void trigger_deinit_interrupt(void)
 {
     gpio_isr_handler_remove(TRIGGER_GPIO);
+#ifdef CONFIG_PM_ENABLE
+    gpio_wakeup_disable(TRIGGER_GPIO);
+#endif
 }
 
-bool trigger_check_and_clear(void)
+bool trigger_receive_event(trigger_event_t *event, TickType_t timeout)
 {
-    if (s_triggered) {
-        s_triggered = false;
-        return true;
+    if (s_event_queue == NULL) {
+        return false;
+    }
+
+    /* Clear before draining so a press queued in between re-sets the bit */
+    if (uxQueueMessagesWaiting(s_event_queue) <= 1) {
+        xEventGroupClearBits(global_event_group, IS_TRIGGER_EVENT);
     }
-    return false;
+    return xQueueReceive(s_event_queue, event, timeout) == pdTRUE;
+}
+
+time_t trigger_event_time(const trigger_event_t *event)
+{
+    time_t now = 0;
+    time(&now);
+
+    TickType_t age_ticks = xTaskGetTickCount() - event->tick;
+    return now - (time_t)(pdTICKS_TO_MS(age_ticks) / 1000);
 }
 
 time_t trigger_get_last_timestamp(void)
 {
-    time_t timestamp = 0;
-    esp_err_t err = nvs_utils_read_timestamp(NVS_TRIGGER_NAMESPACE, NVS_LAST_TRIGGER_KEY, &timestamp);
-    if (err != ESP_OK) {
-        return 0;
-    }
-    return timestamp;
+    return rtc_state_get_last_trigger();
 }
 
 esp_err_t trigger_save_timestamp(time_t timestamp)
 {
-    esp_err_t err = nvs_utils_write_timestamp(NVS_TRIGGER_NAMESPACE, NVS_LAST_TRIGGER_KEY, timestamp);
+    esp_err_t err = rtc_state_set_last_trigger(timestamp);
     if (err == ESP_OK) {
         ESP_LOGI(TAG, "Trigger timestamp saved: %ld", (long)timestamp);
     }
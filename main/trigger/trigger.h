@@ -9,11 +9,27 @@
 #include <esp_err.h>
 #include <stdbool.h>
 #include <time.h>
+#include <freertos/FreeRTOS.h>
+
+/**
+ * @brief A debounced GPIO4 press captured by the interrupt handler
+ */
+typedef struct {
+    TickType_t tick;        /**< Tick count at the falling edge */
+} trigger_event_t;
 
 /**
  * @brief Initialize GPIO4 interrupt for button press detection
+ *
+ * Presses are queued from the ISR as timestamped events and signalled with
+ * IS_TRIGGER_EVENT in the global event group. Call once at boot, after the
+ * global event group is created, so no press is missed while the display
+ * refreshes.
+ *
+ * @param gpio4_wakeup true if a GPIO4 press woke the device; that press is
+ *                     handled by the boot path and its bounces are ignored
  */
-void trigger_init_interrupt(void);
+void trigger_init_interrupt(bool gpio4_wakeup);
 
 /**
  * @brief Remove GPIO4 interrupt handler
@@ -21,10 +37,22 @@ void trigger_init_interrupt(void);
 void trigger_deinit_interrupt(void);
 
 /**
- * @brief Check if GPIO4 button was pressed (and clear flag)
- * @return true if button was pressed since last check
+ * @brief Take the next queued press
+ *
+ * Clears IS_TRIGGER_EVENT once the queue is drained.
+ *
+ * @param event Receives the press
+ * @param timeout Ticks to block waiting for a press (0 to poll)
+ * @return true if a press was received
+ */
+bool trigger_receive_event(trigger_event_t *event, TickType_t timeout);
+
+/**
+ * @brief Convert a press to wall-clock time
+ * @param event Press received from trigger_receive_event()
+ * @return Time of the press
  */
-bool trigger_check_and_clear(void);
+time_t trigger_event_time(const trigger_event_t *event);
 
 /**
  * @brief Get last trigger timestamp from NVS
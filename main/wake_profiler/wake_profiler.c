@@ -0,0 +1,184 @@
+/**
+ * @file wake_profiler.c
+ * @brief Per-wake phase timing kept in RTC memory across deep sleep
+ */
+
+#include <sdkconfig.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "wake_profiler.h"
+
+static const char *TAG = "wake_profiler";
+
+#define WAKE_PROFILER_HISTORY CONFIG_WAKE_PROFILER_HISTORY
+
+typedef struct {
+    uint8_t wake_cause;
+    uint8_t reached;                        /* Bit per wake_phase_t */
+    uint32_t phase_ms[WAKE_PHASE_COUNT];    /* Time since app start */
+    uint32_t radio_on_ms;                   /* Total Wi-Fi radio-on time */
+} wake_record_t;
+
+_Static_assert(WAKE_PHASE_COUNT <= 8, "Phase bitmask must fit in a byte");
+
+/* Zeroed on power-on, kept across deep sleep */
+RTC_DATA_ATTR static struct {
+    uint32_t next;                          /* Slot the current wake writes to */
+    uint32_t count;                         /* Valid records, including the current wake */
+    wake_record_t records[WAKE_PROFILER_HISTORY];
+} s_history;
+
+static wake_record_t *s_current = NULL;
+static int64_t s_radio_on_since = -1;      /* esp_timer time, -1 while off */
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *phase_names[WAKE_PHASE_COUNT] = {
+    [WAKE_PHASE_NVS_INIT] = "nvs",
+    [WAKE_PHASE_DISPLAY_INIT] = "display",
+    [WAKE_PHASE_DISPLAY_UPDATE] = "update",
+    [WAKE_PHASE_WIFI_START] = "wifi",
+    [WAKE_PHASE_WIFI_GOT_IP] = "ip",
+    [WAKE_PHASE_SNTP_DONE] = "sntp",
+    [WAKE_PHASE_OTA_DONE] = "ota",
+    [WAKE_PHASE_DEEP_SLEEP] = "sleep",
+};
+
+static const char *wake_cause_name(uint8_t cause)
+{
+    switch (cause) {
+        case ESP_SLEEP_WAKEUP_EXT1:
+            return "button";
+        case ESP_SLEEP_WAKEUP_TIMER:
+            return "timer";
+        case ESP_SLEEP_WAKEUP_UNDEFINED:
+            return "reset";
+        default:
+            return "other";
+    }
+}
+
+/* Records in age order: index 0 is the oldest */
+static const wake_record_t *history_record(uint32_t index)
+{
+    uint32_t oldest = (s_history.next + WAKE_PROFILER_HISTORY - s_history.count) % WAKE_PROFILER_HISTORY;
+    return &s_history.records[(oldest + index) % WAKE_PROFILER_HISTORY];
+}
+
+void wake_profiler_start(esp_sleep_wakeup_cause_t cause)
+{
+    /* Anything else means RTC memory was not retained */
+    if (s_history.next >= WAKE_PROFILER_HISTORY || s_history.count > WAKE_PROFILER_HISTORY) {
+        memset(&s_history, 0, sizeof(s_history));
+    }
+
+    wake_profiler_dump();
+
+    wake_record_t *record = &s_history.records[s_history.next];
+    memset(record, 0, sizeof(*record));
+    record->wake_cause = (uint8_t)cause;
+
+    s_history.next = (s_history.next + 1) % WAKE_PROFILER_HISTORY;
+    if (s_history.count < WAKE_PROFILER_HISTORY) {
+        s_history.count++;
+    }
+    s_current = record;
+}
+
+void wake_profiler_mark(wake_phase_t phase)
+{
+    if (s_current == NULL || phase >= WAKE_PHASE_COUNT) {
+        return;
+    }
+
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+
+    portENTER_CRITICAL(&s_lock);
+    if (!(s_current->reached & (1 << phase))) {
+        s_current->reached |= (1 << phase);
+        s_current->phase_ms[phase] = now_ms;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void wake_profiler_radio_on(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    if (s_radio_on_since < 0) {
+        s_radio_on_since = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void wake_profiler_radio_off(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_lock);
+    if (s_radio_on_since >= 0) {
+        if (s_current != NULL) {
+            s_current->radio_on_ms += (uint32_t)((now - s_radio_on_since) / 1000);
+        }
+        s_radio_on_since = -1;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void wake_profiler_dump(void)
+{
+    if (s_history.count == 0) {
+        ESP_LOGI(TAG, "No wake history");
+        return;
+    }
+
+    ESP_LOGI(TAG, "Last %lu wakes (ms since app start):", (unsigned long)s_history.count);
+    for (uint32_t i = 0; i < s_history.count; i++) {
+        const wake_record_t *record = history_record(i);
+        char line[128];
+        int len = snprintf(line, sizeof(line), "%-6s", wake_cause_name(record->wake_cause));
+
+        for (int phase = 0; phase < WAKE_PHASE_COUNT && len < (int)sizeof(line); phase++) {
+            if (record->reached & (1 << phase)) {
+                len += snprintf(line + len, sizeof(line) - len, " %s=%lu",
+                                phase_names[phase], (unsigned long)record->phase_ms[phase]);
+            }
+        }
+        if (record->radio_on_ms > 0 && len < (int)sizeof(line)) {
+            snprintf(line + len, sizeof(line) - len, " radio=%lu", (unsigned long)record->radio_on_ms);
+        }
+        ESP_LOGI(TAG, "  %s", line);
+    }
+}
+
+size_t wake_profiler_format(char *buf, size_t size)
+{
+    if (buf == NULL || size == 0) {
+        return 0;
+    }
+
+    size_t len = 0;
+    buf[0] = '\0';
+
+    for (uint32_t i = 0; i < s_history.count && len < size; i++) {
+        const wake_record_t *record = history_record(i);
+        len += snprintf(buf + len, size - len, "%s%u:", i > 0 ? ";" : "", record->wake_cause);
+
+        for (int phase = 0; phase < WAKE_PHASE_COUNT && len < size; phase++) {
+            const char *separator = phase > 0 ? "," : "";
+            if (record->reached & (1 << phase)) {
+                len += snprintf(buf + len, size - len, "%s%lu", separator, (unsigned long)record->phase_ms[phase]);
+            } else {
+                len += snprintf(buf + len, size - len, "%s-", separator);
+            }
+        }
+        if (len < size) {
+            len += snprintf(buf + len, size - len, "/%lu", (unsigned long)record->radio_on_ms);
+        }
+    }
+
+    return len < size ? len : size - 1;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file wake_profiler.h
+ * @brief Per-wake phase timing kept in RTC memory across deep sleep
+ */
+
+#ifndef WAKE_PROFILER_H
+#define WAKE_PROFILER_H
+
+#include <stddef.h>
+#include <esp_sleep.h>
+
+/**
+ * @brief Milestones of a wake, in the order they are normally reached
+ */
+typedef enum {
+    WAKE_PHASE_NVS_INIT,            /**< NVS flash initialized */
+    WAKE_PHASE_DISPLAY_INIT,        /**< E-paper panel powered up */
+    WAKE_PHASE_DISPLAY_UPDATE,      /**< First display update completed */
+    WAKE_PHASE_WIFI_START,          /**< Wi-Fi station started connecting */
+    WAKE_PHASE_WIFI_GOT_IP,         /**< Wi-Fi station got an IP address */
+    WAKE_PHASE_SNTP_DONE,           /**< SNTP sync finished (or skipped) */
+    WAKE_PHASE_OTA_DONE,            /**< OTA check finished (or skipped) */
+    WAKE_PHASE_DEEP_SLEEP,          /**< deep_sleep_enter() called */
+    WAKE_PHASE_COUNT,
+} wake_phase_t;
+
+/**
+ * @brief Log the stored history and start recording a new wake
+ *
+ * Call once, as early as possible in app_main().
+ *
+ * @param cause Wake-up cause of this boot
+ */
+void wake_profiler_start(esp_sleep_wakeup_cause_t cause);
+
+/**
+ * @brief Record the time since app start for a phase
+ *
+ * Only the first mark of each phase per wake is kept. Safe to call from any task.
+ *
+ * @param phase Phase that was reached
+ */
+void wake_profiler_mark(wake_phase_t phase);
+
+/**
+ * @brief Start counting radio-on time for this wake
+ *
+ * Call when the Wi-Fi radio is switched on. Nested calls are ignored.
+ */
+void wake_profiler_radio_on(void);
+
+/**
+ * @brief Stop counting radio-on time and add the interval to this wake
+ *
+ * Call when the radio is switched off, and before deep sleep in case it is
+ * still on. Does nothing if the radio is not being counted.
+ */
+void wake_profiler_radio_off(void);
+
+/**
+ * @brief Log every stored wake, oldest first
+ */
+void wake_profiler_dump(void);
+
+/**
+ * @brief Format the stored wakes as a compact string for upload
+ *
+ * Wakes are separated by ';', oldest first. Each wake is "<cause>:" followed
+ * by the phase times in milliseconds in wake_phase_t order, separated by ',',
+ * with '-' for phases that were not reached, then '/' and the radio-on time
+ * in milliseconds.
+ *
+ * @param buf Output buffer
+ * @param size Size of the output buffer
+ * @return Length of the string written (truncated to fit)
+ */
+size_t wake_profiler_format(char *buf, size_t size);
+
+#endif // WAKE_PROFILER_H
@@ -0,0 +1,231 @@
+/**
+ * @file wake_scheduler.c
+ * @brief Dependency- and deadline-driven bookkeeping for the jobs of one wake
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+
+#include "../global_event_group.h"
+#include "wake_scheduler.h"
+
+static const char *TAG = "wake_scheduler";
+
+_Static_assert(WAKE_JOB_DONE_SHIFT + WAKE_JOB_COUNT <= 24, "Job bits must fit in the event group");
+
+typedef struct {
+    bool needed;
+    uint32_t depends_on;
+    TickType_t deadline;                    /* Ticks since s_start */
+    TickType_t finished;                    /* Ticks since s_start */
+    wake_outcome_t outcome;
+} wake_job_state_t;
+
+static wake_job_state_t s_jobs[WAKE_JOB_COUNT];
+static TickType_t s_start;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *job_names[WAKE_JOB_COUNT] = {
+    [WAKE_JOB_DISPLAY] = "display",
+    [WAKE_JOB_WIFI] = "wifi",
+    [WAKE_JOB_SNTP] = "sntp",
+    [WAKE_JOB_OTA] = "ota",
+    [WAKE_JOB_BATTERY] = "battery",
+};
+
+static const char *outcome_names[] = {
+    [WAKE_OUTCOME_PENDING] = "pending",
+    [WAKE_OUTCOME_DONE] = "done",
+    [WAKE_OUTCOME_SKIPPED] = "skipped",
+    [WAKE_OUTCOME_FAILED] = "failed",
+    [WAKE_OUTCOME_TIMED_OUT] = "timed out",
+};
+
+/* Job mask to the matching bits in global_event_group */
+static EventBits_t job_event_bits(uint32_t jobs)
+{
+    return (EventBits_t)(jobs & WAKE_JOBS_ALL) << WAKE_JOB_DONE_SHIFT;
+}
+
+static TickType_t elapsed_ticks(void)
+{
+    return xTaskGetTickCount() - s_start;
+}
+
+static void finish_job(wake_job_t job, wake_outcome_t outcome)
+{
+    TickType_t now = elapsed_ticks();
+    bool changed = false;
+
+    portENTER_CRITICAL(&s_lock);
+    if (s_jobs[job].outcome == WAKE_OUTCOME_PENDING) {
+        s_jobs[job].outcome = outcome;
+        s_jobs[job].finished = now;
+        changed = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!changed) {
+        return;
+    }
+
+    xEventGroupSetBits(global_event_group, job_event_bits(WAKE_JOB_BIT(job)));
+    if (outcome == WAKE_OUTCOME_DONE || outcome == WAKE_OUTCOME_SKIPPED) {
+        ESP_LOGI(TAG, "%s %s at %lu ms", job_names[job], outcome_names[outcome],
+                 (unsigned long)pdTICKS_TO_MS(now));
+    } else {
+        ESP_LOGW(TAG, "%s %s at %lu ms", job_names[job], outcome_names[outcome],
+                 (unsigned long)pdTICKS_TO_MS(now));
+    }
+}
+
+/* Time out every job past its deadline. Returns the ticks until the next
+ * pending deadline, or portMAX_DELAY if nothing is pending. */
+static TickType_t expire_overdue(void)
+{
+    TickType_t now = elapsed_ticks();
+    TickType_t next = portMAX_DELAY;
+
+    for (int job = 0; job < WAKE_JOB_COUNT; job++) {
+        if (s_jobs[job].outcome != WAKE_OUTCOME_PENDING) {
+            continue;
+        }
+        if (s_jobs[job].deadline <= now) {
+            finish_job(job, WAKE_OUTCOME_TIMED_OUT);
+        } else if (s_jobs[job].deadline - now < next) {
+            next = s_jobs[job].deadline - now;
+        }
+    }
+
+    return next;
+}
+
+void wake_scheduler_init(void)
+{
+    s_start = xTaskGetTickCount();
+
+    for (int job = 0; job < WAKE_JOB_COUNT; job++) {
+        s_jobs[job] = (wake_job_state_t){
+            .needed = false,
+            .outcome = WAKE_OUTCOME_SKIPPED,
+        };
+    }
+
+    /* Jobs nobody adds count as finished */
+    xEventGroupSetBits(global_event_group, job_event_bits(WAKE_JOBS_ALL));
+}
+
+void wake_scheduler_add(wake_job_t job, uint32_t depends_on, uint32_t deadline_ms)
+{
+    if (job >= WAKE_JOB_COUNT) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_jobs[job] = (wake_job_state_t){
+        .needed = true,
+        .depends_on = depends_on & WAKE_JOBS_ALL & ~WAKE_JOB_BIT(job),
+        .deadline = pdMS_TO_TICKS(deadline_ms),
+        .outcome = WAKE_OUTCOME_PENDING,
+    };
+    portEXIT_CRITICAL(&s_lock);
+
+    xEventGroupClearBits(global_event_group, job_event_bits(WAKE_JOB_BIT(job)));
+}
+
+bool wake_scheduler_extend(wake_job_t job, uint32_t ms_from_now)
+{
+    if (job >= WAKE_JOB_COUNT) {
+        return false;
+    }
+
+    TickType_t deadline = elapsed_ticks() + pdMS_TO_TICKS(ms_from_now);
+    bool pending = false;
+
+    portENTER_CRITICAL(&s_lock);
+    if (s_jobs[job].outcome == WAKE_OUTCOME_PENDING) {
+        if (deadline > s_jobs[job].deadline) {
+            s_jobs[job].deadline = deadline;
+        }
+        pending = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (pending) {
+        ESP_LOGI(TAG, "%s deadline extended to %lu ms", job_names[job],
+                 (unsigned long)pdTICKS_TO_MS(s_jobs[job].deadline));
+    } else {
+        ESP_LOGW(TAG, "%s already %s, not extending", job_names[job], outcome_names[s_jobs[job].outcome]);
+    }
+    return pending;
+}
+
+void wake_scheduler_complete(wake_job_t job, wake_outcome_t outcome)
+{
+    if (job >= WAKE_JOB_COUNT || outcome == WAKE_OUTCOME_PENDING) {
+        return;
+    }
+    finish_job(job, outcome);
+}
+
+bool wake_scheduler_wait_deps(wake_job_t job)
+{
+    if (job >= WAKE_JOB_COUNT) {
+        return false;
+    }
+
+    const uint32_t deps = s_jobs[job].depends_on;
+    wake_scheduler_wait(deps, 0);
+
+    for (int dep = 0; dep < WAKE_JOB_COUNT; dep++) {
+        if ((deps & WAKE_JOB_BIT(dep)) && s_jobs[dep].outcome != WAKE_OUTCOME_DONE) {
+            ESP_LOGI(TAG, "%s: dependency %s %s", job_names[job], job_names[dep],
+                     outcome_names[s_jobs[dep].outcome]);
+            return false;
+        }
+    }
+
+    return s_jobs[job].outcome == WAKE_OUTCOME_PENDING;
+}
+
+bool wake_scheduler_wait(uint32_t jobs, EventBits_t interrupt_bits)
+{
+    const EventBits_t job_bits = job_event_bits(jobs);
+
+    while (true) {
+        TickType_t next_deadline = expire_overdue();
+
+        EventBits_t bits = xEventGroupGetBits(global_event_group);
+        if ((bits & job_bits) == job_bits) {
+            return true;
+        }
+        if (bits & interrupt_bits) {
+            return false;
+        }
+
+        /* Wake on any still-running job, an interrupt bit or the next deadline */
+        xEventGroupWaitBits(global_event_group, (job_bits & ~bits) | interrupt_bits,
+                            pdFALSE, pdFALSE, next_deadline);
+    }
+}
+
+void wake_scheduler_log(void)
+{
+    ESP_LOGI(TAG, "Jobs after %lu ms:", (unsigned long)pdTICKS_TO_MS(elapsed_ticks()));
+
+    for (int job = 0; job < WAKE_JOB_COUNT; job++) {
+        const wake_job_state_t *state = &s_jobs[job];
+        if (!state->needed) {
+            continue;
+        }
+        if (state->outcome == WAKE_OUTCOME_PENDING) {
+            ESP_LOGI(TAG, "  %-8s %-9s (deadline %lu ms)", job_names[job], outcome_names[state->outcome],
+                     (unsigned long)pdTICKS_TO_MS(state->deadline));
+        } else {
+            ESP_LOGI(TAG, "  %-8s %-9s %6lu ms (deadline %lu ms)", job_names[job], outcome_names[state->outcome],
+                     (unsigned long)pdTICKS_TO_MS(state->finished),
+                     (unsigned long)pdTICKS_TO_MS(state->deadline));
+        }
+    }
+}
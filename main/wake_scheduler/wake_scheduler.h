@@ -0,0 +1,109 @@
+/**
+ * @file wake_scheduler.h
+ * @brief Dependency- and deadline-driven bookkeeping for the jobs of one wake
+ */
+
+#ifndef WAKE_SCHEDULER_H
+#define WAKE_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+/**
+ * @brief Work that may need to finish before the device goes back to sleep
+ */
+typedef enum {
+    WAKE_JOB_DISPLAY,               /**< Display sequence of show_messages_task */
+    WAKE_JOB_WIFI,                  /**< Wi-Fi station connected */
+    WAKE_JOB_SNTP,                  /**< SNTP time sync */
+    WAKE_JOB_OTA,                   /**< OTA check and, if needed, download */
+    WAKE_JOB_BATTERY,               /**< Battery level measurement */
+    WAKE_JOB_COUNT,
+} wake_job_t;
+
+/**
+ * @brief How a job finished
+ */
+typedef enum {
+    WAKE_OUTCOME_PENDING,           /**< Still running */
+    WAKE_OUTCOME_DONE,              /**< Completed successfully */
+    WAKE_OUTCOME_SKIPPED,           /**< Not needed or a dependency did not complete */
+    WAKE_OUTCOME_FAILED,            /**< Completed with an error */
+    WAKE_OUTCOME_TIMED_OUT,         /**< Deadline passed before the job reported back */
+} wake_outcome_t;
+
+/** Mask of a single job, for dependency and wait masks */
+#define WAKE_JOB_BIT(job) (1UL << (job))
+
+/** Mask of every job */
+#define WAKE_JOBS_ALL (WAKE_JOB_BIT(WAKE_JOB_COUNT) - 1)
+
+/**
+ * @brief Start the wake clock and mark every job as not needed
+ *
+ * Call once from app_main() after global_event_group has been created.
+ */
+void wake_scheduler_init(void);
+
+/**
+ * @brief Declare a job that this wake has to wait for
+ *
+ * @param job Job to add
+ * @param depends_on Mask of jobs that have to complete first (WAKE_JOB_BIT())
+ * @param deadline_ms Deadline in ms since wake_scheduler_init()
+ */
+void wake_scheduler_add(wake_job_t job, uint32_t depends_on, uint32_t deadline_ms);
+
+/**
+ * @brief Push a running job's deadline out, e.g. once an OTA download starts
+ *
+ * Never moves a deadline earlier.
+ *
+ * @param job Job to extend
+ * @param ms_from_now New deadline, relative to now
+ * @return false if the job has already finished or timed out
+ */
+bool wake_scheduler_extend(wake_job_t job, uint32_t ms_from_now);
+
+/**
+ * @brief Report that a job has finished
+ *
+ * Only the first report per job counts; later ones, including a report after
+ * the deadline has passed, are ignored. Safe to call from any task.
+ *
+ * @param job Finished job
+ * @param outcome WAKE_OUTCOME_DONE, _SKIPPED or _FAILED
+ */
+void wake_scheduler_complete(wake_job_t job, wake_outcome_t outcome);
+
+/**
+ * @brief Block until every dependency of a job has finished
+ *
+ * Bounded by the dependencies' own deadlines.
+ *
+ * @param job Job about to start
+ * @return true if every dependency completed successfully and the job itself
+ *         has not timed out meanwhile; the caller should skip the job otherwise
+ */
+bool wake_scheduler_wait_deps(wake_job_t job);
+
+/**
+ * @brief Block until the given jobs have finished or timed out
+ *
+ * The waiting task also enforces deadlines: jobs that pass theirs are
+ * marked as timed out.
+ *
+ * @param jobs Mask of jobs to wait for (WAKE_JOB_BIT())
+ * @param interrupt_bits Bits in global_event_group that end the wait early, or 0
+ * @return true once all jobs have finished, false if an interrupt bit was set first
+ */
+bool wake_scheduler_wait(uint32_t jobs, EventBits_t interrupt_bits);
+
+/**
+ * @brief Log the outcome, finish time and deadline of every needed job
+ */
+void wake_scheduler_log(void);
+
+#endif // WAKE_SCHEDULER_H
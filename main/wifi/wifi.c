@@ -1,27 +1,268 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
 #include <esp_system.h>
 #include <esp_wifi.h>
 #include <esp_log.h>
 #include <esp_event.h>
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
+#include <esp_mac.h>
+#include <esp_timer.h>
 #include <lwip/err.h>
 #include <lwip/sys.h>
+#include <lwip/etharp.h>
 #include <string.h>
 
 #include "global_event_group.h"
+#include "../wake_profiler/wake_profiler.h"
+#include "../wake_scheduler/wake_scheduler.h"
+#include "../nvs_utils/nvs_utils.h"
+#include "../rtc_state/rtc_state.h"
+#include "../power_mgmt/power_mgmt.h"
 
 #include "wifi.h"
 
 #define SSID CONFIG_WIFI_SSID
 #define PASSWORD CONFIG_WIFI_PASSWORD
-#define WIFI_CONNECTED_DELAY_MS 5000
+// The link counts as ready once the gateway answers ARP. ARP never blocks the
+// way a DNS lookup can, and the budget stays well under the Wi-Fi job deadline.
+#define WIFI_READY_PROBE_BUDGET_MS 2000
+#define WIFI_READY_PROBE_INTERVAL_MS 200
+// Time DHCP gets after association before the cached lease is applied statically
+#define WIFI_DHCP_FALLBACK_MS 3000
+// Time another host gets to answer an ARP probe for the cached address
+#define WIFI_LEASE_PROBE_WAIT_MS 500
+
+// Listen interval (in beacons) while in max modem sleep
+#define WIFI_LISTEN_INTERVAL 3
 
 #define IP_OBTAINED_BIT BIT0
+#define IP_LOST_BIT BIT1
 
 static const char *TAG = "Wi-Fi";
 static EventGroupHandle_t wifi_internal_event_group;
 static bool wifi_should_reconnect = true;
 
+static esp_netif_t *sta_netif;
+static esp_timer_handle_t dhcp_fallback_timer;
+static esp_timer_handle_t lease_probe_timer;
+static int64_t wifi_start_us;
+
+// Power-save policy state, guarded by power_mutex
+static SemaphoreHandle_t power_mutex;
+static int power_phase_count[WIFI_POWER_PHASE_COUNT];
+static wifi_ps_type_t power_mode = WIFI_PS_NONE;
+static int64_t power_mode_since_us;
+static int64_t power_mode_time_us[WIFI_PS_MAX_MODEM + 1];
+
+static const char *power_mode_names[WIFI_PS_MAX_MODEM + 1] = {
+  [WIFI_PS_NONE] = "none",
+  [WIFI_PS_MIN_MODEM] = "min modem",
+  [WIFI_PS_MAX_MODEM] = "max modem",
+};
+
+// AP and lease of the last successful connection, and of this one
+static rtc_state_wifi_t cached_wifi;
+static rtc_state_wifi_t current_wifi;
+static bool has_cached_wifi = false;
+static bool using_cached_ap = false;
+static bool using_cached_lease = false;
+
+// ARP requests and lookups for one address; both run in the TCP/IP thread
+typedef struct {
+  struct netif *netif;
+  ip4_addr_t addr;
+} arp_probe_t;
+
+static esp_err_t arp_probe_send(void *ctx)
+{
+  arp_probe_t *probe = ctx;
+  // Adds a pending ARP entry that the reply turns into a stable one
+  return etharp_query(probe->netif, &probe->addr, NULL) == ERR_OK ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t arp_probe_check(void *ctx)
+{
+  arp_probe_t *probe = ctx;
+  struct eth_addr *eth_ret;
+  const ip4_addr_t *ip_ret;
+  return etharp_find_addr(probe->netif, &probe->addr, &eth_ret, &ip_ret) >= 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+// Drop the BSSID and channel hint so the next connect scans every channel
+static void use_full_scan(void)
+{
+  wifi_config_t config;
+  esp_wifi_get_config(WIFI_IF_STA, &config);
+  config.sta.bssid_set = false;
+  config.sta.channel = 0;
+  esp_wifi_set_config(WIFI_IF_STA, &config);
+  using_cached_ap = false;
+}
+
+static arp_probe_t lease_probe;
+
+// The cached lease may have expired and its address been handed to another
+// host; probe for it first (sender address 0.0.0.0, as in RFC 5227)
+static void dhcp_fallback_callback(void *arg)
+{
+  lease_probe.netif = esp_netif_get_netif_impl(sta_netif);
+  lease_probe.addr.addr = cached_wifi.ip;
+  esp_netif_tcpip_exec(arp_probe_send, &lease_probe);
+  esp_timer_start_once(lease_probe_timer, WIFI_LEASE_PROBE_WAIT_MS * 1000);
+}
+
+static void lease_probe_callback(void *arg)
+{
+  if (esp_netif_tcpip_exec(arp_probe_check, &lease_probe) == ESP_OK) {
+    ESP_LOGW(TAG, "Cached address " IPSTR " is in use by another host, waiting for DHCP",
+             IP2STR((esp_ip4_addr_t *)&cached_wifi.ip));
+    return;
+  }
+
+  ESP_LOGW(TAG, "No DHCP lease after %d ms, using cached lease " IPSTR,
+           WIFI_DHCP_FALLBACK_MS, IP2STR((esp_ip4_addr_t *)&cached_wifi.ip));
+
+  using_cached_lease = true;
+  esp_netif_dhcpc_stop(sta_netif);
+
+  esp_netif_ip_info_t ip_info = {
+      .ip.addr = cached_wifi.ip,
+      .netmask.addr = cached_wifi.netmask,
+      .gw.addr = cached_wifi.gw,
+  };
+  esp_netif_dns_info_t dns_info = {
+      .ip.type = ESP_IPADDR_TYPE_V4,
+      .ip.u_addr.ip4.addr = cached_wifi.dns,
+  };
+  // Posts IP_EVENT_STA_GOT_IP like a DHCP lease would
+  esp_netif_set_ip_info(sta_netif, &ip_info);
+  esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns_info);
+}
+
+// Remember the AP and lease for the next wake; NVS is only written if they changed
+static void save_wifi_cache(void)
+{
+  if (using_cached_lease) {
+    current_wifi.ip = cached_wifi.ip;
+    current_wifi.netmask = cached_wifi.netmask;
+    current_wifi.gw = cached_wifi.gw;
+    current_wifi.dns = cached_wifi.dns;
+  } else {
+    esp_netif_dns_info_t dns_info;
+    if (esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns_info) == ESP_OK) {
+      current_wifi.dns = dns_info.ip.u_addr.ip4.addr;
+    }
+  }
+  strlcpy(current_wifi.ssid, SSID, sizeof(current_wifi.ssid));
+
+  if (rtc_state_set_wifi(&current_wifi) != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to store AP and lease");
+  }
+}
+
+// Call with power_mutex held
+static void apply_power_mode(void)
+{
+  wifi_ps_type_t mode = WIFI_PS_MAX_MODEM;
+  if (power_phase_count[WIFI_POWER_CONNECT] > 0 || power_phase_count[WIFI_POWER_BULK] > 0) {
+    mode = WIFI_PS_NONE;
+  } else if (power_phase_count[WIFI_POWER_INTERACTIVE] > 0) {
+    mode = WIFI_PS_MIN_MODEM;
+  }
+
+  if (mode == power_mode) {
+    return;
+  }
+
+  int64_t now_us = esp_timer_get_time();
+  power_mode_time_us[power_mode] += now_us - power_mode_since_us;
+  power_mode_since_us = now_us;
+  power_mode = mode;
+
+  esp_wifi_set_ps(mode);
+  ESP_LOGD(TAG, "Power save: %s", power_mode_names[mode]);
+}
+
+static void update_power_phase(wifi_power_phase_t phase, int delta)
+{
+  // Nothing to adjust before wifi_task has started the station
+  if (power_mutex == NULL || phase >= WIFI_POWER_PHASE_COUNT) {
+    return;
+  }
+
+  xSemaphoreTake(power_mutex, portMAX_DELAY);
+  power_phase_count[phase] += delta;
+  if (power_phase_count[phase] < 0) {
+    power_phase_count[phase] = 0;
+  }
+  apply_power_mode();
+  xSemaphoreGive(power_mutex);
+}
+
+void wifi_power_begin(wifi_power_phase_t phase)
+{
+  update_power_phase(phase, 1);
+}
+
+void wifi_power_end(wifi_power_phase_t phase)
+{
+  update_power_phase(phase, -1);
+}
+
+static void log_power_usage(void)
+{
+  if (power_mutex == NULL) {
+    return;
+  }
+
+  xSemaphoreTake(power_mutex, portMAX_DELAY);
+  int64_t now_us = esp_timer_get_time();
+  power_mode_time_us[power_mode] += now_us - power_mode_since_us;
+  power_mode_since_us = now_us;
+
+  ESP_LOGI(TAG, "Power save time: none %lld ms, min modem %lld ms, max modem %lld ms",
+           power_mode_time_us[WIFI_PS_NONE] / 1000, power_mode_time_us[WIFI_PS_MIN_MODEM] / 1000,
+           power_mode_time_us[WIFI_PS_MAX_MODEM] / 1000);
+  xSemaphoreGive(power_mutex);
+}
+
+static bool wait_network_ready(void)
+{
+  esp_netif_ip_info_t ip_info;
+  if (esp_netif_get_ip_info(sta_netif, &ip_info) != ESP_OK || ip_info.gw.addr == 0) {
+    ESP_LOGW(TAG, "No gateway to probe, continuing anyway");
+    return true;
+  }
+
+  arp_probe_t probe = {
+      .netif = esp_netif_get_netif_impl(sta_netif),
+      .addr.addr = ip_info.gw.addr,
+  };
+  int64_t start_us = esp_timer_get_time();
+
+  for (int attempt = 1; attempt <= WIFI_READY_PROBE_BUDGET_MS / WIFI_READY_PROBE_INTERVAL_MS; attempt++) {
+    esp_netif_tcpip_exec(arp_probe_send, &probe);
+    vTaskDelay(pdMS_TO_TICKS(WIFI_READY_PROBE_INTERVAL_MS));
+
+    if (esp_netif_tcpip_exec(arp_probe_check, &probe) == ESP_OK) {
+      ESP_LOGI(TAG, "Network ready after %lld ms (gateway answered ARP probe %d)",
+               (esp_timer_get_time() - start_us) / 1000, attempt);
+      return true;
+    }
+
+    // A dropped connection restarts the wait for an IP address
+    if (!(xEventGroupGetBits(wifi_internal_event_group) & IP_OBTAINED_BIT)) {
+      return false;
+    }
+  }
+
+  ESP_LOGW(TAG, "Gateway " IPSTR " did not answer within %d ms, continuing anyway",
+           IP2STR(&ip_info.gw), WIFI_READY_PROBE_BUDGET_MS);
+  return true;
+}
+
 static void client_mode_event_handler(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
   if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
@@ -36,13 +277,27 @@ static void client_mode_event_handler(void *event_handler_arg, esp_event_base_t
     break;
 
   case WIFI_EVENT_STA_CONNECTED:
-    ESP_LOGI(TAG, "Connected to SSID: %s", SSID);
+    wifi_event_sta_connected_t *connected = (wifi_event_sta_connected_t *)event_data;
+    ESP_LOGI(TAG, "Connected to SSID: %s (" MACSTR ", channel %d)", SSID, MAC2STR(connected->bssid), connected->channel);
+    memcpy(current_wifi.bssid, connected->bssid, sizeof(current_wifi.bssid));
+    current_wifi.channel = connected->channel;
+    if (has_cached_wifi && cached_wifi.ip != 0 && !using_cached_lease) {
+      esp_timer_start_once(dhcp_fallback_timer, WIFI_DHCP_FALLBACK_MS * 1000);
+    }
     break;
 
   case WIFI_EVENT_STA_DISCONNECTED:
     xEventGroupClearBits(global_event_group, IS_WIFI_CONNECTED_BIT);
     xEventGroupClearBits(wifi_internal_event_group, IP_OBTAINED_BIT);
+    xEventGroupSetBits(wifi_internal_event_group, IP_LOST_BIT);
+    esp_timer_stop(dhcp_fallback_timer);
+    esp_timer_stop(lease_probe_timer);
     if (wifi_should_reconnect) {
+      if (using_cached_ap) {
+        wifi_event_sta_disconnected_t *disconnected = (wifi_event_sta_disconnected_t *)event_data;
+        ESP_LOGW(TAG, "Cached AP failed (reason %d), falling back to a full scan", disconnected->reason);
+        use_full_scan();
+      }
       ESP_LOGI(TAG, "Lost connection. Reconnecting...");
       xEventGroupSetBits(global_event_group, IS_WIFI_FAILED_BIT);
       esp_wifi_connect();
@@ -53,8 +308,20 @@ static void client_mode_event_handler(void *event_handler_arg, esp_event_base_t
 
   case IP_EVENT_STA_GOT_IP:
     ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-    ESP_LOGI(TAG, "Got IP Address: " IPSTR, IP2STR(&event->ip_info.ip));
+    esp_timer_stop(dhcp_fallback_timer);
+    esp_timer_stop(lease_probe_timer);
+    ESP_LOGI(TAG, "Got IP Address: " IPSTR " %lld ms after start (%s, %s)",
+             IP2STR(&event->ip_info.ip), (esp_timer_get_time() - wifi_start_us) / 1000,
+             using_cached_ap ? "cached AP" : "full scan",
+             using_cached_lease ? "cached lease" : "DHCP");
+    wake_profiler_mark(WAKE_PHASE_WIFI_GOT_IP);
+    if (!using_cached_lease) {
+      current_wifi.ip = event->ip_info.ip.addr;
+      current_wifi.netmask = event->ip_info.netmask.addr;
+      current_wifi.gw = event->ip_info.gw.addr;
+    }
     xEventGroupClearBits(global_event_group, IS_WIFI_FAILED_BIT);
+    xEventGroupClearBits(wifi_internal_event_group, IP_LOST_BIT);
     xEventGroupSetBits(wifi_internal_event_group, IP_OBTAINED_BIT);
     break;
 
@@ -69,18 +336,36 @@ void wifi_task(void *pvParameter)
 
   if (!(xEventGroupGetBits(global_event_group) & IS_WIFI_AVAILABLE)) {
     ESP_LOGI(TAG, "Wi-Fi not available for this wake-up, skipping");
+    wake_scheduler_complete(WAKE_JOB_WIFI, WAKE_OUTCOME_SKIPPED);
     vTaskDelete(NULL);
     return;
   }
 
   wifi_internal_event_group = xEventGroupCreate();
 
+  // PHY calibration data lives in NVS (CONFIG_ESP_PHY_CALIBRATION_AND_DATA_STORAGE),
+  // so a deep-sleep wake-up skips the RF calibration
+  nvs_utils_init();
+
   esp_netif_init();
   esp_event_loop_create_default();
 
-  esp_netif_create_default_wifi_sta();
+  sta_netif = esp_netif_create_default_wifi_sta();
   wifi_init_config_t wifi_initiation = WIFI_INIT_CONFIG_DEFAULT();
   esp_wifi_init(&wifi_initiation);
+  // The configuration is rebuilt on every wake, don't rewrite it to flash
+  esp_wifi_set_storage(WIFI_STORAGE_RAM);
+
+  const esp_timer_create_args_t fallback_timer_args = {
+      .callback = dhcp_fallback_callback,
+      .name = "dhcp_fallback",
+  };
+  esp_timer_create(&fallback_timer_args, &dhcp_fallback_timer);
+  const esp_timer_create_args_t probe_timer_args = {
+      .callback = lease_probe_callback,
+      .name = "lease_probe",
+  };
+  esp_timer_create(&probe_timer_args, &lease_probe_timer);
 
   esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, client_mode_event_handler, NULL);
   esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, client_mode_event_handler, NULL);
@@ -88,51 +373,73 @@ void wifi_task(void *pvParameter)
   wifi_config_t client_configuration = {
       .sta = {
           .threshold.authmode = WIFI_AUTH_WPA2_PSK,
+          .listen_interval = WIFI_LISTEN_INTERVAL,
       },
   };
 
   strlcpy((char *)client_configuration.sta.ssid, SSID, sizeof(client_configuration.sta.ssid));
   strlcpy((char *)client_configuration.sta.password, PASSWORD, sizeof(client_configuration.sta.password));
 
+  // Connect straight to the last AP on its channel instead of scanning every channel
+  memset(&current_wifi, 0, sizeof(current_wifi));
+  has_cached_wifi = rtc_state_get_wifi(&cached_wifi) && strcmp(cached_wifi.ssid, SSID) == 0 && cached_wifi.channel != 0;
+  if (has_cached_wifi) {
+    ESP_LOGI(TAG, "Using cached AP " MACSTR " on channel %d", MAC2STR(cached_wifi.bssid), cached_wifi.channel);
+    client_configuration.sta.bssid_set = true;
+    memcpy(client_configuration.sta.bssid, cached_wifi.bssid, sizeof(client_configuration.sta.bssid));
+    client_configuration.sta.channel = cached_wifi.channel;
+    using_cached_ap = true;
+  } else {
+    ESP_LOGI(TAG, "No cached AP, scanning");
+  }
+
   esp_wifi_set_mode(WIFI_MODE_STA);
   esp_wifi_set_config(WIFI_IF_STA, &client_configuration);
+  // Stay awake while connecting; SNTP and OTA pick the mode once the link is up
+  power_mutex = xSemaphoreCreateMutex();
+  power_phase_count[WIFI_POWER_CONNECT] = 1;
+  power_mode = WIFI_PS_NONE;
   esp_wifi_set_ps(WIFI_PS_NONE);
 
   xEventGroupClearBits(global_event_group, IS_WIFI_FAILED_BIT);
   xEventGroupClearBits(global_event_group, IS_WIFI_CONNECTED_BIT);
 
+  wake_profiler_mark(WAKE_PHASE_WIFI_START);
+  wifi_start_us = esp_timer_get_time();
+  power_mode_since_us = wifi_start_us;
+  wake_profiler_radio_on();
+  // Full clock from association until the link is usable
+  power_mgmt_acquire(POWER_LOCK_WIFI);
   esp_wifi_start();
 
   while (true) {
     // Wait for IP address to be obtained
-    EventBits_t bits = xEventGroupWaitBits(wifi_internal_event_group,
-                                           IP_OBTAINED_BIT,
-                                           pdFALSE,
-                                           pdTRUE,
-                                           portMAX_DELAY);
-
-    if (bits & IP_OBTAINED_BIT) {
-      // Wi-Fi connected successfully, wait 5 seconds before setting WIFI_CONNECTED bit
-      ESP_LOGI(TAG, "Waiting %d ms before activating WIFI_CONNECTED bit", WIFI_CONNECTED_DELAY_MS);
-      vTaskDelay(pdMS_TO_TICKS(WIFI_CONNECTED_DELAY_MS));
-
-      xEventGroupSetBits(global_event_group, IS_WIFI_CONNECTED_BIT);
-      ESP_LOGI(TAG, "WIFI_CONNECTED bit activated");
-
-      // Wait for disconnection by checking if the bit gets cleared
-      while (xEventGroupGetBits(wifi_internal_event_group) & IP_OBTAINED_BIT) {
-        vTaskDelay(pdMS_TO_TICKS(1000));
-      }
+    xEventGroupWaitBits(wifi_internal_event_group, IP_OBTAINED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+    save_wifi_cache();
 
-      if (!wifi_should_reconnect) {
-        ESP_LOGI(TAG, "Wi-Fi task exiting");
-        vTaskDelete(NULL);
-      }
+    // Probe instead of waiting a fixed time before SNTP and OTA start using the link
+    if (!wait_network_ready()) {
+      ESP_LOGI(TAG, "Connection lost while probing, waiting for reconnection");
+      continue;
+    }
+
+    power_mgmt_release(POWER_LOCK_WIFI);
+    wifi_power_end(WIFI_POWER_CONNECT);
+    xEventGroupSetBits(global_event_group, IS_WIFI_CONNECTED_BIT);
+    wake_scheduler_complete(WAKE_JOB_WIFI, WAKE_OUTCOME_DONE);
+    ESP_LOGI(TAG, "WIFI_CONNECTED bit activated");
+
+    // Block until the connection drops
+    xEventGroupWaitBits(wifi_internal_event_group, IP_LOST_BIT, pdTRUE, pdTRUE, portMAX_DELAY);
 
-      ESP_LOGI(TAG, "Disconnected, waiting for reconnection");
+    if (!wifi_should_reconnect) {
+      ESP_LOGI(TAG, "Wi-Fi task exiting");
+      vTaskDelete(NULL);
     }
 
-    vTaskDelay(pdMS_TO_TICKS(100));
+    ESP_LOGI(TAG, "Disconnected, waiting for reconnection");
+    power_mgmt_acquire(POWER_LOCK_WIFI);
+    wifi_power_begin(WIFI_POWER_CONNECT);
   }
 }
 
@@ -142,6 +449,9 @@ void wifi_stop(void)
   wifi_should_reconnect = false;
   esp_wifi_disconnect();
   esp_wifi_stop();
+  wake_profiler_radio_off();
+  ESP_LOGI(TAG, "Radio was on for %lld ms", (esp_timer_get_time() - wifi_start_us) / 1000);
+  log_power_usage();
 }
 
 void wifi_disconnect_task(void *pvParameter)
@@ -152,10 +462,11 @@ void wifi_disconnect_task(void *pvParameter)
         return;
     }
 
+    // Bounded by the OTA and SNTP deadlines
     ESP_LOGI(TAG, "Waiting for OTA check and SNTP sync to complete...");
-    xEventGroupWaitBits(global_event_group, IS_OTA_CHECK_DONE | IS_SNTP_SYNC_DONE, pdFALSE, pdTRUE, portMAX_DELAY);
+    wake_scheduler_wait(WAKE_JOB_BIT(WAKE_JOB_OTA) | WAKE_JOB_BIT(WAKE_JOB_SNTP), 0);
 
-    ESP_LOGI(TAG, "OTA and SNTP done, disconnecting Wi-Fi");
+    ESP_LOGI(TAG, "OTA and SNTP finished, disconnecting Wi-Fi");
     wifi_stop();
 
     vTaskDelete(NULL);
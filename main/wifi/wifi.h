@@ -1,8 +1,22 @@
 #ifndef WIFI_H
 #define WIFI_H
 
+// What the link is being used for; the most demanding active phase picks the
+// modem power-save mode (none for bulk transfers and connecting, min modem for
+// request/response traffic, max modem when nothing needs the link)
+typedef enum {
+  WIFI_POWER_CONNECT,
+  WIFI_POWER_BULK,
+  WIFI_POWER_INTERACTIVE,
+  WIFI_POWER_PHASE_COUNT,
+} wifi_power_phase_t;
+
 void wifi_task(void *pvParameter);
 void wifi_stop(void);
 void wifi_disconnect_task(void *pvParameter);
 
-#endif // WIFI_H
\ No newline at end of file
+// Calls nest per phase; every wifi_power_begin() needs a matching wifi_power_end()
+void wifi_power_begin(wifi_power_phase_t phase);
+void wifi_power_end(wifi_power_phase_t phase);
+
+#endif // WIFI_H
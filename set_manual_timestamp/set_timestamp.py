@@ -22,7 +22,7 @@ from pathlib import Path
 NVS_SIZE_BYTES = 0x4000  # 16 K
 NVS_PARTITION_NAME = "nvs"
 
-# NVS keys (must match trigger.c / sntp.c)
+# NVS keys (must match main/rtc_state/rtc_state.c)
 TRIGGER_NAMESPACE = "trigger_info"
 TRIGGER_KEY = "last_gpio4"
 SNTP_NAMESPACE = "sntp_info"